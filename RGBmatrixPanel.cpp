@@ -53,11 +53,13 @@ BSD license, all text above must be included in any redistribution.
 // Pointers are a peculiar case...typically 16-bit on AVR boards,
 // 32 bits elsewhere.  Try to accommodate both...
 
+#ifndef pgm_read_pointer
 #if !defined(__INT_MAX__) || (__INT_MAX__ > 0xFFFF)
  #define pgm_read_pointer(addr) ((void *)pgm_read_dword(addr))
 #else
  #define pgm_read_pointer(addr) ((void *)pgm_read_word(addr))
 #endif
+#endif
 
 inline GFXglyph * pgm_read_glyph_ptr(const GFXfont *gfxFont, uint8_t c)
 {
@@ -72,6 +74,9 @@ inline uint8_t * pgm_read_bitmap_ptr(const GFXfont *gfxFont)
 #ifndef min
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 #endif
+#ifndef max
+#define max(a,b) (((a) > (b)) ? (a) : (b))
+#endif
 
 #ifndef _swap_int16_t
 #define _swap_int16_t(a, b) { int16_t t = a; a = b; b = t; }
@@ -216,8 +221,13 @@ void RGBmatrixPanel_printNumber(unsigned long n, uint8_t base)
 /**************************************************************************/
 void RGBmatrixPanel_Adafruit_GFX(int16_t w, int16_t h)
 {
+#ifndef MATRIX_WIDTH
 	WIDTH = w;
 	HEIGHT = h;
+#else
+	(void)w;
+	(void)h;
+#endif
     _width    = WIDTH;
     _height   = HEIGHT;
     rotation  = 0;
@@ -359,53 +369,32 @@ void RGBmatrixPanel_endWrite(){
 
 /**************************************************************************/
 /*!
-   @brief    Draw a perfectly vertical line (this is often optimized in a subclass!)
+   @brief    Draw a perfectly vertical line, via the packed-plane RGBmatrixPanel_fillRect()
     @param    x   Top-most x coordinate
     @param    y   Top-most y coordinate
-    @param    h   Height in pixels
+    @param    h   Height in pixels (negative extends upward)
    @param    color 16-bit 5-6-5 Color to RGBmatrixPanel_fill with
 */
 /**************************************************************************/
 void RGBmatrixPanel_drawFastVLine(int16_t x, int16_t y,
         int16_t h, uint16_t color) {
-    RGBmatrixPanel_startWrite();
-    RGBmatrixPanel_writeLine(x, y, x, y+h-1, color);
-    RGBmatrixPanel_endWrite();
+    if(h < 0) { y += h + 1; h = -h; }
+    RGBmatrixPanel_fillRect(x, y, 1, h, color);
 }
 
 /**************************************************************************/
 /*!
-   @brief    Draw a perfectly horizontal line (this is often optimized in a subclass!)
+   @brief    Draw a perfectly horizontal line, via the packed-plane RGBmatrixPanel_fillRect()
     @param    x   Left-most x coordinate
     @param    y   Left-most y coordinate
-    @param    w   Width in pixels
+    @param    w   Width in pixels (negative extends leftward)
    @param    color 16-bit 5-6-5 Color to RGBmatrixPanel_fill with
 */
 /**************************************************************************/
 void RGBmatrixPanel_drawFastHLine(int16_t x, int16_t y,
         int16_t w, uint16_t color) {
-    RGBmatrixPanel_startWrite();
-    RGBmatrixPanel_writeLine(x, y, x+w-1, y, color);
-    RGBmatrixPanel_endWrite();
-}
-
-/**************************************************************************/
-/*!
-   @brief    Fill a rectangle completely with one color. Update in subclasses if desired!
-    @param    x   Top left corner x coordinate
-    @param    y   Top left corner y coordinate
-    @param    w   Width in pixels
-    @param    h   Height in pixels
-   @param    color 16-bit 5-6-5 Color to RGBmatrixPanel_fill with
-*/
-/**************************************************************************/
-void RGBmatrixPanel_fillRect(int16_t x, int16_t y, int16_t w, int16_t h,
-        uint16_t color) {
-    RGBmatrixPanel_startWrite();
-    for (int16_t i=x; i<x+w; i++) {
-        RGBmatrixPanel_writeFastVLine(i, y, h, color);
-    }
-    RGBmatrixPanel_endWrite();
+    if(w < 0) { x += w + 1; w = -w; }
+    RGBmatrixPanel_fillRect(x, y, w, 1, color);
 }
 
 /**************************************************************************/
@@ -823,13 +812,16 @@ void RGBmatrixPanel_drawBitmap(int16_t x, int16_t y,
 
     int16_t byteWidth = (w + 7) / 8; // Bitmap scanline pad = whole byte
     uint8_t byte = 0;
+    RGBmatrixPanel_Pattern fg, bp;   // Colors alternate; work both out once
 
+    RGBmatrixPanel_makePattern(color, &fg);
+    RGBmatrixPanel_makePattern(bg, &bp);
     RGBmatrixPanel_startWrite();
     for(int16_t j=0; j<h; j++, y++) {
         for(int16_t i=0; i<w; i++ ) {
             if(i & 7) byte <<= 1;
             else      byte   = pgm_read_byte(&bitmap[j * byteWidth + i / 8]);
-            RGBmatrixPanel_writePixel(x+i, y, (byte & 0x80) ? color : bg);
+            RGBmatrixPanel_drawPixelPattern(x+i, y, (byte & 0x80) ? &fg : &bp);
         }
     }
     RGBmatrixPanel_endWrite();
@@ -880,13 +872,16 @@ void RGBmatrixPanel_drawBitmap(int16_t x, int16_t y,
 
     int16_t byteWidth = (w + 7) / 8; // Bitmap scanline pad = whole byte
     uint8_t byte = 0;
+    RGBmatrixPanel_Pattern fg, bp;   // Colors alternate; work both out once
 
+    RGBmatrixPanel_makePattern(color, &fg);
+    RGBmatrixPanel_makePattern(bg, &bp);
     RGBmatrixPanel_startWrite();
     for(int16_t j=0; j<h; j++, y++) {
         for(int16_t i=0; i<w; i++ ) {
             if(i & 7) byte <<= 1;
             else      byte   = bitmap[j * byteWidth + i / 8];
-            RGBmatrixPanel_writePixel(x+i, y, (byte & 0x80) ? color : bg);
+            RGBmatrixPanel_drawPixelPattern(x+i, y, (byte & 0x80) ? &fg : &bp);
         }
     }
     RGBmatrixPanel_endWrite();
@@ -1157,6 +1152,86 @@ void RGBmatrixPanel_drawChar(int16_t x, int16_t y, unsigned char c,
     RGBmatrixPanel_drawChar(x, y, c, color, bg, size, size);
 }
 
+// A run of glyph pixels, cut to columns cx0 <= x < cx1.
+static void RGBmatrixPanel_glyphRun(int16_t x, int16_t y, int16_t w,
+  int16_t h, uint16_t color, int16_t cx0, int16_t cx1) {
+    if(x < cx0) {
+        w -= cx0 - x;
+        x  = cx0;
+    }
+    if(x + w > cx1) w = cx1 - x;
+    if(w > 0) RGBmatrixPanel_writeFillRect(x, y, w, h, color);
+}
+
+/**************************************************************************/
+/*!
+   @brief   Draw a custom font glyph bitmap, clipped to the display and to
+            a range of columns.  Used by RGBmatrixPanel_drawChar() and for
+            laid-out text, which has its glyph metrics to hand already.
+    @param    left     Left edge of the glyph bitmap (cursor + xOffset)
+    @param    top      Top edge of the glyph bitmap (cursor + yOffset)
+    @param    bitmap   The glyph's first bitmap byte, in PROGMEM
+    @param    w        Glyph bitmap width in font pixels
+    @param    h        Glyph bitmap height in font pixels
+    @param    color    16-bit 5-6-5 Color to draw it with
+    @param    size_x   Font magnification level in X-axis, 1 is 'original' size
+    @param    size_y   Font magnification level in Y-axis, 1 is 'original' size
+    @param    cx0      Leftmost column to draw
+    @param    cx1      Column after the rightmost to draw
+*/
+/**************************************************************************/
+void RGBmatrixPanel_drawGlyph(int16_t left, int16_t top,
+  const uint8_t *bitmap, uint8_t w, uint8_t h, uint16_t color,
+  uint8_t size_x, uint8_t size_y, int16_t cx0, int16_t cx1) {
+    uint8_t  xx, yy, yy1, run, bits = 0, bit;
+    uint16_t bo, skip;
+
+    // Clip: nothing to do for a glyph wholly outside, and bitmap rows
+    // above or below the display are skipped, not decoded.
+    if(cx0 < 0)       cx0 = 0;
+    if(cx1 > _width)  cx1 = _width;
+    if((left >= cx1) || (top >= _height) ||
+       (left + w * size_x <= cx0) || (top + h * size_y <= 0)) return;
+    yy = (top < 0) ? (-top / size_y) : 0;
+    if(top + h * size_y > _height)
+         yy1 = (_height - top + size_y - 1) / size_y;
+    else yy1 = h;
+    skip = (uint16_t)yy * w; // Bits before first visible row
+    bo   = skip >> 3;
+    bit  = skip & 7;
+    if(bit) bits = pgm_read_byte(&bitmap[bo++]) << bit;
+
+    // Each row goes out as horizontal runs of set bits, one span fill
+    // per run rather than a pixel at a time.
+    RGBmatrixPanel_startWrite();
+    for(; yy<yy1; yy++) {
+        for(xx=0, run=0; xx<w; xx++) {
+            if(!(bit++ & 7)) {
+                bits = pgm_read_byte(&bitmap[bo++]);
+            }
+            if(bits & 0x80) {
+                run++;
+            } else if(run) {
+                RGBmatrixPanel_glyphRun(left + (xx - run) * size_x,
+                  top + yy * size_y, run * size_x, size_y, color, cx0, cx1);
+                run = 0;
+            }
+            bits <<= 1;
+        }
+        if(run) {
+            RGBmatrixPanel_glyphRun(left + (w - run) * size_x,
+              top + yy * size_y, run * size_x, size_y, color, cx0, cx1);
+        }
+    }
+    RGBmatrixPanel_endWrite();
+}
+
+// Text is drawn a character at a time, nearly always in the same pair of
+// colors; their patterns are kept for the next character.
+static RGBmatrixPanel_Pattern textpattern[2]; // Foreground, background
+static uint16_t               textcolors[2];
+static bool                   textvalid = false;
+
 // Draw a character
 /**************************************************************************/
 /*!
@@ -1184,25 +1259,35 @@ void RGBmatrixPanel_drawChar(int16_t x, int16_t y, unsigned char c,
         if(!_cp437 && (c >= 176)) c++; // Handle 'classic' charset behavior
 
         RGBmatrixPanel_startWrite();
-        for(int8_t i=0; i<5; i++ ) { // Char bitmap = 5 columns
-            uint8_t line = pgm_read_byte(&font[c * 5 + i]);
-            for(int8_t j=0; j<8; j++, line >>= 1) {
-                if(line & 1) {
-                    if(size_x == 1 && size_y == 1)
-                        RGBmatrixPanel_writePixel(x+i, y+j, color);
-                    else
+        if(size_x == 1 && size_y == 1) { // Whole font columns at a time
+            if(!textvalid || (color != textcolors[0]) || (bg != textcolors[1])) {
+                RGBmatrixPanel_makePattern(color, &textpattern[0]);
+                RGBmatrixPanel_makePattern(bg, &textpattern[1]);
+                textcolors[0] = color;
+                textcolors[1] = bg;
+                textvalid     = true;
+            }
+            const RGBmatrixPanel_Pattern *fgp = &textpattern[0],
+                                         *bgp = (bg != color) ? &textpattern[1] : NULL;
+            for(int8_t i=0; i<5; i++ ) { // Char bitmap = 5 columns
+                RGBmatrixPanel_drawColumnPattern(x+i, y,
+                  pgm_read_byte(&font[c * 5 + i]), 8, fgp, bgp);
+            }
+            if(bgp) RGBmatrixPanel_drawColumnPattern(x+5, y, 0, 8, fgp, bgp);
+        } else {
+            for(int8_t i=0; i<5; i++ ) { // Char bitmap = 5 columns
+                uint8_t line = pgm_read_byte(&font[c * 5 + i]);
+                for(int8_t j=0; j<8; j++, line >>= 1) {
+                    if(line & 1) {
                         RGBmatrixPanel_writeFillRect(x+i*size_x, y+j*size_y, size_x, size_y, color);
-                } else if(bg != color) {
-                    if(size_x == 1 && size_y == 1)
-                        RGBmatrixPanel_writePixel(x+i, y+j, bg);
-                    else
+                    } else if(bg != color) {
                         RGBmatrixPanel_writeFillRect(x+i*size_x, y+j*size_y, size_x, size_y, bg);
+                    }
                 }
             }
-        }
-        if(bg != color) { // If opaque, RGBmatrixPanel_draw vertical line for last column
-            if(size_x == 1 && size_y == 1) RGBmatrixPanel_writeFastVLine(x+5, y, 8, bg);
-            else          RGBmatrixPanel_writeFillRect(x+5*size_x, y, size_x, 8*size_y, bg);
+            if(bg != color) { // If opaque, RGBmatrixPanel_draw vertical line for last column
+                RGBmatrixPanel_writeFillRect(x+5*size_x, y, size_x, 8*size_y, bg);
+            }
         }
         RGBmatrixPanel_endWrite();
 
@@ -1221,15 +1306,6 @@ void RGBmatrixPanel_drawChar(int16_t x, int16_t y, unsigned char c,
                  h  = pgm_read_byte(&glyph->height);
         int8_t   xo = pgm_read_byte(&glyph->xOffset),
                  yo = pgm_read_byte(&glyph->yOffset);
-        uint8_t  xx, yy, bits = 0, bit = 0;
-        int16_t  xo16 = 0, yo16 = 0;
-
-        if(size_x > 1 || size_y > 1) {
-            xo16 = xo;
-            yo16 = yo;
-        }
-
-        // Todo: Add character clipping here
 
         // NOTE: THERE IS NO 'BACKGROUND' COLOR OPTION ON CUSTOM FONTS.
         // THIS IS ON PURPOSE AND BY DESIGN.  The background color feature
@@ -1238,33 +1314,15 @@ void RGBmatrixPanel_drawChar(int16_t x, int16_t y, unsigned char c,
         // characters are a uniform size; it's not a sensible thing to do with
         // proportionally-spaced fonts with glyphs of varying sizes (and that
         // may overlap).  To replace previously-drawn text when using a custom
-        // font, use the getTextBounds() function to determine the smallest
-        // rectangle encompassing a string, erase the area with RGBmatrixPanel_fillRect(),
-        // then RGBmatrixPanel_draw new text.  This WILL infortunately 'blink' the text, but
-        // is unavoidable.  Drawing 'background' pixels will NOT fix this,
-        // only creates a new RGBmatrixPanel_set of problems.  Have an idea to work around
-        // this (a canvas object type for MCUs that can afford the RAM and
-        // displays supporting RGBmatrixPanel_setAddrWindow() and pushColors()), but haven't
-        // implemented this yet.
+        // font, use RGBmatrixPanel_drawTextOpaque(), which writes the box
+        // and the text together, each pixel once.  (Erasing the
+        // getTextBounds() rectangle with RGBmatrixPanel_fillRect() and then
+        // drawing the new text WILL unfortunately 'blink' the text.)
+        // Drawing 'background' pixels per glyph will NOT fix this, only
+        // creates a new set of problems.
 
-        RGBmatrixPanel_startWrite();
-        for(yy=0; yy<h; yy++) {
-            for(xx=0; xx<w; xx++) {
-                if(!(bit++ & 7)) {
-                    bits = pgm_read_byte(&bitmap[bo++]);
-                }
-                if(bits & 0x80) {
-                    if(size_x == 1 && size_y == 1) {
-                        RGBmatrixPanel_writePixel(x+xo+xx, y+yo+yy, color);
-                    } else {
-                        RGBmatrixPanel_writeFillRect(x+(xo16+xx)*size_x, y+(yo16+yy)*size_y,
-                          size_x, size_y, color);
-                    }
-                }
-                bits <<= 1;
-            }
-        }
-        RGBmatrixPanel_endWrite();
+        RGBmatrixPanel_drawGlyph(x + xo * size_x, y + yo * size_y,
+          &bitmap[bo], w, h, color, size_x, size_y, 0, _width);
 
     } // End classic vs custom font
 }
@@ -1398,8 +1456,9 @@ void RGBmatrixPanel_setFont(const GFXfont *f) {
     @param    maxy  Maximum clipping value for Y
 */
 /**************************************************************************/
-void RGBmatrixPanel_charBounds(char c, int16_t *x, int16_t *y,
+void RGBmatrixPanel_charBounds(char ch, int16_t *x, int16_t *y,
   int16_t *minx, int16_t *miny, int16_t *maxx, int16_t *maxy) {
+    uint8_t c = ch; // Unsigned, as RGBmatrixPanel_write() sees it
 
     if(gfxFont) {
 
@@ -1416,21 +1475,25 @@ void RGBmatrixPanel_charBounds(char c, int16_t *x, int16_t *y,
                         xa = pgm_read_byte(&glyph->xAdvance);
                 int8_t  xo = pgm_read_byte(&glyph->xOffset),
                         yo = pgm_read_byte(&glyph->yOffset);
-                if(wrap && ((*x+(((int16_t)xo+gw)*textsize_x)) > _width)) {
-                    *x  = 0; // Reset x to zero, advance y by one line
-                    *y += textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+                // Blank glyphs (spaces) neither wrap nor count toward
+                // the bounds, matching what RGBmatrixPanel_write() draws.
+                if(gw && gh) {
+                    if(wrap && ((*x+(((int16_t)xo+gw)*textsize_x)) > _width)) {
+                        *x  = 0; // Reset x to zero, advance y by one line
+                        *y += textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+                    }
+                    int16_t tsx = (int16_t)textsize_x,
+                            tsy = (int16_t)textsize_y,
+                            x1 = *x + xo * tsx,
+                            y1 = *y + yo * tsy,
+                            x2 = x1 + gw * tsx - 1,
+                            y2 = y1 + gh * tsy - 1;
+                    if(x1 < *minx) *minx = x1;
+                    if(y1 < *miny) *miny = y1;
+                    if(x2 > *maxx) *maxx = x2;
+                    if(y2 > *maxy) *maxy = y2;
                 }
-                int16_t tsx = (int16_t)textsize_x,
-                        tsy = (int16_t)textsize_y,
-                        x1 = *x + xo * tsx,
-                        y1 = *y + yo * tsy,
-                        x2 = x1 + gw * tsx - 1,
-                        y2 = y1 + gh * tsy - 1;
-                if(x1 < *minx) *minx = x1;
-                if(y1 < *miny) *miny = y1;
-                if(x2 > *maxx) *maxx = x2;
-                if(y2 > *maxy) *maxy = y2;
-                *x += xa * tsx;
+                *x += xa * (int16_t)textsize_x;
             }
         }
 
@@ -1476,7 +1539,9 @@ void RGBmatrixPanel_getTextBounds(const char *str, int16_t x, int16_t y,
     *y1 = y;
     *w  = *h = 0;
 
-    int16_t minx = _width, miny = _height, maxx = -1, maxy = -1;
+    // Start from the extremes, not the display edges: text running off
+    // the top or left must still measure its true size.
+    int16_t minx = 0x7FFF, miny = 0x7FFF, maxx = -0x8000, maxy = -0x8000;
 
     while((c = *str++))
         RGBmatrixPanel_charBounds(c, &x, &y, &minx, &miny, &maxx, &maxy);
@@ -1490,24 +1555,368 @@ void RGBmatrixPanel_getTextBounds(const char *str, int16_t x, int16_t y,
         *h  = maxy - miny + 1;
     }
 }
+
+/**************************************************************************/
+/*!
+    @brief    Width of one line of text in the current font and size: just
+              the sum of the cursor advances, for centering or right-aligning
+              labels without working out full bounds.  Stops at a newline
+              and ignores wrapping.  For custom fonts this is the advance,
+              which can differ by a pixel or two from the inked width
+              RGBmatrixPanel_getTextBounds() gives.
+    @param    str     The ascii string to measure
+    @returns  Width in pixels
+*/
+/**************************************************************************/
+int16_t RGBmatrixPanel_textWidth(const char *str) {
+    uint8_t c;
+    int16_t w = 0;
+
+    if(!gfxFont) {
+        while((c = *str++) && (c != '\n')) {
+            if(c != '\r') w += 6;
+        }
+    } else {
+        uint8_t first = pgm_read_byte(&gfxFont->first),
+                last  = pgm_read_byte(&gfxFont->last);
+        while((c = *str++) && (c != '\n')) {
+            if((c >= first) && (c <= last)) {
+                w += (uint8_t)pgm_read_byte(
+                  &pgm_read_glyph_ptr(gfxFont, c - first)->xAdvance);
+            }
+        }
+    }
+    return w * (int16_t)textsize_x;
+}
+
+#define OPAQUEGLYPHS 16 // Glyph metrics held at a time; more take passes
+
+/**************************************************************************/
+/*!
+    @brief    Draw one line of text with an opaque background, classic or
+              custom font, at the current text size.  Every pixel of the
+              box is written once, fg where the text is and bg elsewhere,
+              so there is no erase pass to 'blink' the text (the custom
+              font problem described in RGBmatrixPanel_drawChar()).  The
+              metrics of the glyphs in the box are read once, then box
+              rows are built one at a time in a bit mask and written out
+              as fg and bg runs.  Stops at a newline; the cursor is not
+              moved and nothing wraps.  For a changing readout, pass the
+              box its widest value needs, so each update covers the last.
+    @param    str     The ascii string to draw
+    @param    x       Cursor X, as for RGBmatrixPanel_setCursor()
+    @param    y       Cursor Y (baseline, for custom fonts)
+    @param    fg      16-bit 5-6-5 text color
+    @param    bg      16-bit 5-6-5 background color
+    @param    bx      Box left; text outside the box is cut off
+    @param    by      Box top
+    @param    bw      Box width
+    @param    bh      Box height
+*/
+/**************************************************************************/
+void RGBmatrixPanel_drawTextOpaque(const char *str, int16_t x, int16_t y,
+  uint16_t fg, uint16_t bg, int16_t bx, int16_t by, uint16_t bw,
+  uint16_t bh) {
+    RGBmatrixPanel_Pattern fp, bp;
+    struct {
+      int16_t  left, top;
+      uint16_t bo;     // Bitmap offset, or classic font offset
+      uint8_t  w, h;
+    } glyph[OPAQUEGLYPHS];
+    uint8_t     rowbits[32], sx = textsize_x, sy = textsize_y, c, bits,
+                w, h, ng, i, xx;
+    uint16_t    bo = 0;
+    int16_t     x0 = bx, x1 = bx + bw, y0 = by, y1 = by + bh,
+                row, cx, left, top, px, n, start, end;
+    const char *s;
+    const uint8_t *bitmap = gfxFont ? pgm_read_bitmap_ptr(gfxFont) : NULL;
+
+    // Clip the box to the display; a row mask covers 256 pixels
+    if(x0 < 0)        x0 = 0;
+    if(y0 < 0)        y0 = 0;
+    if(x1 > _width)   x1 = _width;
+    if(y1 > _height)  y1 = _height;
+    if(x1 > x0 + 256) x1 = x0 + 256;
+    if((x0 >= x1) || (y0 >= y1)) return;
+
+    RGBmatrixPanel_makePattern(fg, &fp);
+    RGBmatrixPanel_makePattern(bg, &bp);
+
+    RGBmatrixPanel_startWrite();
+    for(; x0<x1; x0=end) {
+        // Read the metrics of each glyph reaching into the box from
+        // column x0 on, advancing the cursor as RGBmatrixPanel_write()
+        // would.  If there are more than fit, this pass stops at the
+        // first one left out, and the next pass starts there.
+        for(s=str, cx=x, ng=0, end=x1; (c = *s) && (c != '\n'); s++) {
+            if(c == '\r') continue;
+            if(!gfxFont) {
+                if(!_cp437 && (c >= 176)) c++;
+                left = cx;
+                top  = y;
+                w    = 5;
+                h    = 8;
+                bo   = c * 5;
+                cx  += 6 * sx;
+            } else {
+                uint8_t first = pgm_read_byte(&gfxFont->first);
+                if((c < first) || (c > (uint8_t)pgm_read_byte(&gfxFont->last)))
+                    continue;
+                GFXglyph *g = pgm_read_glyph_ptr(gfxFont, c - first);
+                bo   = pgm_read_word(&g->bitmapOffset);
+                w    = pgm_read_byte(&g->width);
+                h    = pgm_read_byte(&g->height);
+                left = cx + (int8_t)pgm_read_byte(&g->xOffset) * sx;
+                top  = y  + (int8_t)pgm_read_byte(&g->yOffset) * sy;
+                cx  += (uint8_t)pgm_read_byte(&g->xAdvance) * (int16_t)sx;
+            }
+            if(!w || (top >= y1) || (top + h * sy <= y0) ||
+               (left >= end) || (left + w * sx <= x0)) continue;
+            if(ng == OPAQUEGLYPHS) {
+                end = (left > x0) ? left : x0 + 1; // Always some progress
+                continue;
+            }
+            glyph[ng].left = left;
+            glyph[ng].top  = top;
+            glyph[ng].bo   = bo;
+            glyph[ng].w    = w;
+            glyph[ng].h    = h;
+            ng++;
+        }
+
+        for(row=y0; row<y1; row++) {
+            memset(rowbits, 0, (end - x0 + 7) >> 3);
+
+            // Set the mask bit of each text pixel on this row
+            for(i=0; i<ng; i++) {
+                top = glyph[i].top;
+                if((row < top) || (row >= top + glyph[i].h * sy)) continue;
+                uint8_t  j = (row - top) / sy;
+                uint16_t b = (uint16_t)j * glyph[i].w;
+                for(xx=0, left=glyph[i].left; xx<glyph[i].w; xx++, b++, left+=sx) {
+                    if(!gfxFont) {
+                        bits = (pgm_read_byte(&font[glyph[i].bo + xx]) >> j) & 1;
+                    } else {
+                        bits = pgm_read_byte(&bitmap[glyph[i].bo + (b >> 3)]) &
+                          (0x80 >> (b & 7));
+                    }
+                    if(!bits) continue;
+                    for(px=left, n=sx; n--; px++) {
+                        if((px >= x0) && (px < end))
+                            rowbits[(px - x0) >> 3] |= 0x80 >> ((px - x0) & 7);
+                    }
+                }
+            }
+
+            // Write the row as alternating runs of background and text
+            for(px=x0; px<end; ) {
+                start = px;
+                bits  = rowbits[(px - x0) >> 3] & (0x80 >> ((px - x0) & 7));
+                while((++px < end) && (!(rowbits[(px - x0) >> 3] &
+                  (0x80 >> ((px - x0) & 7))) == !bits));
+                RGBmatrixPanel_fillRectPattern(start, row, px - start, 1,
+                  bits ? &fp : &bp);
+            }
+        }
+    }
+    RGBmatrixPanel_endWrite();
+}
+
+/**************************************************************************/
+/*!
+    @brief    Draw one line of text with an opaque background covering
+              just the text's own bounds, at the cursor position.
+    @param    str     The ascii string to draw
+    @param    fg      16-bit 5-6-5 text color
+    @param    bg      16-bit 5-6-5 background color
+*/
+/**************************************************************************/
+void RGBmatrixPanel_drawTextOpaque(const char *str, uint16_t fg,
+  uint16_t bg) {
+    int16_t  bx, by;
+    uint16_t bw, bh;
+    bool     w = wrap;
+
+    wrap = false; // Measure it as drawn, on one line
+    RGBmatrixPanel_getTextBounds(str, cursor_x, cursor_y, &bx, &by, &bw, &bh);
+    wrap = w;
+    RGBmatrixPanel_drawTextOpaque(str, cursor_x, cursor_y, fg, bg,
+      bx, by, bw, bh);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Measure and place a string once, in the current font, size
+              and wrap setting, for RGBmatrixPanel_drawLayout() to redraw
+              with no further PROGMEM metric lookups.  Lines break as
+              RGBmatrixPanel_write() would break them printing at (x,y);
+              blank glyphs (spaces) take no slot.
+    @param    l       Layout to fill in
+    @param    glyphs  Array to place glyphs in, 8 bytes each
+    @param    max     Size of that array; the string is cut off after it
+    @param    str     The ascii string to lay out
+    @param    x       Cursor X it is laid out at (affects wrapping only)
+    @param    y       Cursor Y it is laid out at (affects wrapping only)
+    @returns  Number of glyphs placed
+*/
+/**************************************************************************/
+uint8_t RGBmatrixPanel_layoutText(RGBmatrixPanel_TextLayout *l,
+  RGBmatrixPanel_LaidGlyph *glyphs, uint8_t max, const char *str,
+  int16_t x, int16_t y) {
+    RGBmatrixPanel_LaidGlyph *g = glyphs;
+    int16_t  cx = x, cy = y, gx, gy, minx = 0x7FFF, miny = 0x7FFF,
+             maxx = -0x8000, maxy = -0x8000, sx = textsize_x,
+             sy = textsize_y, lh;
+    uint8_t  c, first = 0, last = 0, w, h, xa;
+    const uint8_t *bitmap;
+
+    if(gfxFont) {
+        first = pgm_read_byte(&gfxFont->first);
+        last  = pgm_read_byte(&gfxFont->last);
+        lh    = (uint8_t)pgm_read_byte(&gfxFont->yAdvance) * sy;
+    } else {
+        lh    = 8 * sy;
+    }
+
+    l->glyph   = glyphs;
+    l->size_x  = sx;
+    l->size_y  = sy;
+    l->classic = !gfxFont;
+
+    while((c = *str++) && ((uint8_t)(g - glyphs) < max)) {
+        if(c == '\n') {
+            cx  = 0;
+            cy += lh;
+            continue;
+        }
+        if(c == '\r') continue;
+        if(!gfxFont) {
+            if(!_cp437 && (c >= 176)) c++;
+            if(wrap && ((cx + sx * 6) > _width)) {
+                cx  = 0;
+                cy += lh;
+            }
+            bitmap = &font[c * 5];
+            w = 5, h = 8, xa = 6;
+            gx = cx;
+            gy = cy;
+            // Bounds are the whole 6x8 cell, as RGBmatrixPanel_charBounds()
+            if(gx < minx) minx = gx;
+            if(gy < miny) miny = gy;
+            if(gx + 6 * sx - 1 > maxx) maxx = gx + 6 * sx - 1;
+            if(gy + 8 * sy - 1 > maxy) maxy = gy + 8 * sy - 1;
+            if(!(pgm_read_byte(&bitmap[0]) | pgm_read_byte(&bitmap[1]) |
+                 pgm_read_byte(&bitmap[2]) | pgm_read_byte(&bitmap[3]) |
+                 pgm_read_byte(&bitmap[4]))) w = 0;
+        } else {
+            if((c < first) || (c > last)) continue;
+            GFXglyph *glyph = pgm_read_glyph_ptr(gfxFont, c - first);
+            w      = pgm_read_byte(&glyph->width);
+            h      = pgm_read_byte(&glyph->height);
+            xa     = pgm_read_byte(&glyph->xAdvance);
+            int8_t xo = pgm_read_byte(&glyph->xOffset),
+                   yo = pgm_read_byte(&glyph->yOffset);
+            bitmap = &pgm_read_bitmap_ptr(gfxFont)[
+              pgm_read_word(&glyph->bitmapOffset)];
+            if(w && h && wrap && ((cx + sx * (xo + w)) > _width)) {
+                cx  = 0;
+                cy += lh;
+            }
+            gx = cx + xo * sx;
+            gy = cy + yo * sy;
+            if(w && h) {
+                if(gx < minx) minx = gx;
+                if(gy < miny) miny = gy;
+                if(gx + w * sx - 1 > maxx) maxx = gx + w * sx - 1;
+                if(gy + h * sy - 1 > maxy) maxy = gy + h * sy - 1;
+            }
+        }
+        if(w && h) {
+            g->bitmap = bitmap;
+            g->x      = gx - x;
+            g->y      = gy - y;
+            g->w      = w;
+            g->h      = h;
+            g++;
+        }
+        cx += xa * sx;
+    }
+
+    l->count   = g - glyphs;
+    l->advance = cx - x;
+    l->x1 = l->y1 = 0;
+    l->w  = l->h  = 0;
+    if(maxx >= minx) {
+        l->x1 = minx - x;
+        l->w  = maxx - minx + 1;
+    }
+    if(maxy >= miny) {
+        l->y1 = miny - y;
+        l->h  = maxy - miny + 1;
+    }
+    return l->count;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Draw a string laid out by RGBmatrixPanel_layoutText(), with
+              its origin at (x,y).  Only glyphs inside the window of
+              columns wx to wx+ww-1 are drawn, and those cut to it, so a
+              marquee can scroll by drawing at x = wx - offset and only
+              the few glyphs in view cost anything.
+    @param    l       The laid-out string
+    @param    x       Origin X (the cursor X it was laid out for)
+    @param    y       Origin Y
+    @param    color   16-bit 5-6-5 text color
+    @param    wx      Window left column
+    @param    ww      Window width; the default is the whole display
+*/
+/**************************************************************************/
+void RGBmatrixPanel_drawLayout(const RGBmatrixPanel_TextLayout *l,
+  int16_t x, int16_t y, uint16_t color, int16_t wx, int16_t ww) {
+    const RGBmatrixPanel_LaidGlyph *g = l->glyph;
+    RGBmatrixPanel_Pattern fg;
+    int16_t  cx0 = wx, cx1 = _width, gx, gy, px;
+    uint8_t  sx = l->size_x, sy = l->size_y, n, i, j, line;
+
+    if(cx0 < 0) cx0 = 0;
+    if((int32_t)wx + ww < cx1) cx1 = wx + ww;
+    if(cx0 >= cx1) return;
+    if(l->classic) RGBmatrixPanel_makePattern(color, &fg);
+
+    RGBmatrixPanel_startWrite();
+    for(n=l->count; n--; g++) {
+        gx = x + g->x;
+        gy = y + g->y;
+        if((gx >= cx1) || (gx + g->w * sx <= cx0)) continue; // Out of window
+        if(!l->classic) {
+            RGBmatrixPanel_drawGlyph(gx, gy, g->bitmap, g->w, g->h, color,
+              sx, sy, cx0, cx1);
+            continue;
+        }
+        for(i=0; i<5; i++) { // Classic: 5 font columns, bit j = row j
+            px = gx + i * sx;
+            if((px >= cx1) || (px + sx <= cx0)) continue;
+            line = pgm_read_byte(&g->bitmap[i]);
+            if((sx == 1) && (sy == 1)) {
+                RGBmatrixPanel_drawColumnPattern(px, gy, line, 8, &fg, NULL);
+            } else {
+                for(j=0; line; j++, line >>= 1) {
+                    if(line & 1) RGBmatrixPanel_glyphRun(px, gy + j * sy, sx,
+                      sy, color, cx0, cx1);
+                }
+            }
+        }
+    }
+    RGBmatrixPanel_endWrite();
+}
 ///
 
 #ifndef _swap_int16_t
 #define _swap_int16_t(a, b) { int16_t t = a; a = b; b = t; }
 #endif
 
-// A full PORT register is required for the data lines, though only the
-// top 6 output bits are used.  For performance reasons, the port # cannot
-// be changed via library calls, only by changing constants in the library.
-// For similar reasons, the clock pin is only semi-configurable...it can
-// be specified as any pin within a specific PORT register stated below.
-
- // Ports for "standard" boards (Arduino Uno, Duemilanove, etc.)
-#define DATAPORT PORTD
-#define DATADIR  DDRD
-#define CLKPORT  PORTB
-
-#define nPlanes 4
+// DATAPORT, DATADIR, CLKPORT and nPlanes are set in config.h.
 
 // The fact that the display driver interrupt stuff is tied to the
 // singular Timer1 doesn't really take well to object orientation with
@@ -1519,18 +1928,42 @@ void RGBmatrixPanel_getTextBounds(const char *str, int16_t x, int16_t y,
 // are even an actual need.
 
 // Code common to both the 16x32 and 32x32 constructors:
-void RGBmatrixPanel_init(uint8_t rows, bool dbuf, uint8_t width
-  ) {
-
-  nRows = rows; // Number of multiplexed rows; actual height is 2X this
+// tbuf adds a third buffer (implying dbuf): a finished frame then waits
+// in it for the interrupt, so swapBuffers() never has to.
+void RGBmatrixPanel_init(uint8_t rows, bool dbuf, uint8_t width,
+  bool tbuf) {
+
+#ifndef MATRIX_WIDTH
+  nRows = rows;  // Number of multiplexed rows; actual height is 2X this
+  WIDTH = width; // Buffer lines are this wide (ROWBYTES is by WIDTH)
+#else
+  (void)rows;    // Both fixed at compile time
+  (void)width;
+#endif
 
   // Allocate and RGBmatrixPanel_initialize matrix buffer:
-  int buffsize  = width * nRows * 3, // x3 = 3 bytes holds 4 planes "packed"
-      allocsize = (dbuf == true) ? (buffsize * 2) : buffsize;
+  if(tbuf) dbuf = true;
+  int buffsize  = nRows * ROWBYTES, // e.g. 3 bytes hold 4 planes "packed"
+      allocsize = buffsize * (tbuf ? 3 : (dbuf ? 2 : 1));
   if(NULL == (matrixbuff[0] = (uint8_t *)malloc(allocsize))) return;
+  rowsource  = NULL; // Row cache is sized to the panel, so start over
+  rowpending = NULL;
+  free(rowcache);
+  rowcache   = NULL;
+#ifdef PALETTEBITS
+  // Black and white, and for 4 colors red and green between them
+  RGBmatrixPanel_setPalette(0, 0x0000);
+  if(PALETTEBITS == 2) {
+    RGBmatrixPanel_setPalette(1, 0xF800);
+    RGBmatrixPanel_setPalette(2, 0x07E0);
+  }
+  RGBmatrixPanel_setPalette((1 << PALETTEBITS) - 1, 0xFFFF);
+#endif
   memset(matrixbuff[0], 0, allocsize);
   // If not double-buffered, both buffers then point to the same address:
   matrixbuff[1] = (dbuf == true) ? &matrixbuff[0][buffsize] : matrixbuff[0];
+  matrixbuff[2] = tbuf ? &matrixbuff[0][buffsize * 2] : matrixbuff[1];
+  memset(rowdirty, 0, sizeof(rowdirty)); // Both buffers equal (clear)
 
   // Save pin numbers for use by begin() method later.
 
@@ -1539,7 +1972,14 @@ void RGBmatrixPanel_init(uint8_t rows, bool dbuf, uint8_t width
   plane     = nPlanes - 1;
   row       = nRows   - 1;
   swapflag  = false;
-  backindex = 0;     // Array index of back buffer
+  swapcopy  = false;
+  triplebuf = tbuf;
+  backindex  = 0;           // Array index of back buffer
+  frontindex = dbuf ? 1 : 0;
+  readyindex = tbuf ? 2 : 0; // With 2 buffers, the back one is next
+#ifdef PALETTEBITS
+  RGBmatrixPanel_setRowSource(NULL); // Rows expand from palette indices
+#endif
 }
 
 // Constructor for 16x32 panel:
@@ -1549,16 +1989,28 @@ void RGBmatrixPanel_RGBmatrixPanel(bool dbuf)  {
 }
 
 // Constructor for 32x32 or 32x64 panel:
-void RGBmatrixPanel_RGBmatrixPanel(bool dbuf, uint8_t width){
+void RGBmatrixPanel_RGBmatrixPanel(bool dbuf, uint8_t width, bool tbuf){
   RGBmatrixPanel_Adafruit_GFX(width, 32);	
-  RGBmatrixPanel_init(16, dbuf, width);
+  RGBmatrixPanel_init(16, dbuf, width, tbuf);
 }
 
 
 void RGBmatrixPanel_begin(void) {
+  RGBmatrixPanel_begin(false);
+}
 
-  backindex   = 0;                         // Back buffer
-  buffptr     = matrixbuff[1 - backindex]; // -> front buffer
+// interleave selects the interleaved scan (see updateDisplay()): rows
+// change on every interrupt, so each row is lit nPlanes times a frame
+// rather than once, for a higher apparent refresh at the same CPU load.
+void RGBmatrixPanel_begin(bool interleave) {
+  uint8_t p;
+
+  buffptr     = matrixbuff[frontindex]; // -> front buffer
+  if(rowsource || rowpending) interleave = false; // Rows expand whole
+  scaninterleave = interleave;
+  scanblock      = nRows - 1;
+  // Row shown with each plane is staggered evenly through the frame
+  for(p=0; p<nPlanes; p++) scanoffset[p] = (p * nRows) / nPlanes;
 
   // Enable all comm & address pins as outputs, RGBmatrixPanel_set default states:
   CLK_DDR |=  1 << CLK_PIN; CLK_PORT &= ~(1 << CLK_PIN);
@@ -1624,16 +2076,24 @@ uint16_t RGBmatrixPanel_Color888(uint8_t r, uint8_t g, uint8_t b) {
   return ((uint16_t)(r & 0xF8) << 8) | ((uint16_t)(g & 0xFC) << 3) | (b >> 3);
 }
 
+// Scale an nPlanes-bit level back up to 8 bits by repeating its bits,
+// so that truncating to 5/6/5 and then to nPlanes bits returns it as-is.
+static uint8_t RGBmatrixPanel_levelTo8(uint8_t v) {
+  uint8_t w = v << (8 - nPlanes), s;
+  for(s=nPlanes; s<8; s+=nPlanes) w |= w >> nPlanes;
+  return w;
+}
+
 // 8/8/8 -> gamma -> 5/6/5
 uint16_t RGBmatrixPanel_Color888(
   uint8_t r, uint8_t g, uint8_t b, bool gflag) {
   if(gflag) { // Gamma-corrected color?
     r = pgm_read_byte(&gamma_table[r]); // Gamma correction table maps
-    g = pgm_read_byte(&gamma_table[g]); // 8-bit input to 4-bit output
+    g = pgm_read_byte(&gamma_table[g]); // 8-bit input to nPlanes-bit output
     b = pgm_read_byte(&gamma_table[b]);
-    return ((uint16_t)r << 12) | ((uint16_t)(r & 0x8) << 8) | // 4/4/4->5/6/5
-           ((uint16_t)g <<  7) | ((uint16_t)(g & 0xC) << 3) |
-           (          b <<  1) | (           b        >> 3);
+    r = RGBmatrixPanel_levelTo8(r);
+    g = RGBmatrixPanel_levelTo8(g);
+    b = RGBmatrixPanel_levelTo8(b);
   } // else linear (uncorrected) color
   return ((uint16_t)(r & 0xF8) << 8) | ((uint16_t)(g & 0xFC) << 3) | (b >> 3);
 }
@@ -1670,20 +2130,175 @@ uint16_t RGBmatrixPanel_ColorHSV(
   v1 = val + 1;
   if(gflag) { // Gamma-corrected color?
     r = pgm_read_byte(&gamma_table[(r * v1) >> 8]); // Gamma correction table maps
-    g = pgm_read_byte(&gamma_table[(g * v1) >> 8]); // 8-bit input to 4-bit output
+    g = pgm_read_byte(&gamma_table[(g * v1) >> 8]); // 8-bit input to nPlanes-bit output
     b = pgm_read_byte(&gamma_table[(b * v1) >> 8]);
+    r = RGBmatrixPanel_levelTo8(r);
+    g = RGBmatrixPanel_levelTo8(g);
+    b = RGBmatrixPanel_levelTo8(b);
   } else { // linear (uncorrected) color
-    r = (r * v1) >> 12; // 4-bit results
-    g = (g * v1) >> 12;
-    b = (b * v1) >> 12;
+    r = RGBmatrixPanel_levelTo8((r * v1) >> (16 - nPlanes)); // nPlanes-bit
+    g = RGBmatrixPanel_levelTo8((g * v1) >> (16 - nPlanes)); // results, bits
+    b = RGBmatrixPanel_levelTo8((b * v1) >> (16 - nPlanes)); // repeated
+  }
+  return RGBmatrixPanel_Color888(r, g, b);
+}
+
+// Most drawing runs many pixels of one color in a row;
+// RGBmatrixPanel_colorPattern() remembers the pattern for the last
+// color asked for.
+static RGBmatrixPanel_Pattern cachedpattern;
+static uint16_t               cachedcolor;
+static bool                   cachedvalid = false;
+
+#ifdef PALETTEBITS
+// Set palette entry i to 5-6-5 color c.  Pixels already drawn with that
+// index change color on the next scan; colors drawn from then on map
+// to the nearest entry of the new palette.
+void RGBmatrixPanel_setPalette(uint8_t i, uint16_t c) {
+  uint8_t lv[1 << PALETTEBITS][3], n, p, j, bits;
+
+  palette[i]  = c;
+  cachedvalid = false; // Nearest entries may have changed
+  textvalid   = false;
+
+  // Each entry's nPlanes-bit levels, widened as in makePattern()
+  for(n=0; n<(1 << PALETTEBITS); n++) {
+    c = palette[n];
+    lv[n][0] = (((c >> 8) & 0xF8) | (c >> 13))         >> (8 - nPlanes);
+    lv[n][1] = (((c >> 3) & 0xFC) | ((c >> 9) & 0x03)) >> (8 - nPlanes);
+    lv[n][2] = (((c << 3) & 0xF8) | ((c >> 2) & 0x07)) >> (8 - nPlanes);
+  }
+  // Port bits of every upper/lower index pair, plane by plane
+  for(n=0; n<(1 << (2 * PALETTEBITS)); n++) {
+    uint8_t *top = lv[n & ((1 << PALETTEBITS) - 1)],
+            *bot = lv[n >> PALETTEBITS];
+    for(p=0; p<nPlanes; p++) {
+      for(j=0, bits=0; j<3; j++) {
+        bits |= (((top[j] >> p) & 1) << (j + 2)) |
+                (((bot[j] >> p) & 1) << (j + 5));
+      }
+      paletteport[n][p] = bits;
+    }
   }
-  return (r << 12) | ((r & 0x8) << 8) | // 4/4/4 -> 5/6/5
-         (g <<  7) | ((g & 0xC) << 3) |
-         (b <<  1) | ( b        >> 3);
+}
+
+// Palette entry closest to 5-6-5 color c (5-bit red and blue doubled
+// to weigh the same as 6-bit green).
+static uint8_t RGBmatrixPanel_paletteIndex(uint16_t c) {
+  uint8_t  i, best = 0;
+  uint16_t d, bestd = 0xFFFF;
+  int8_t   dr, dg, db;
+
+  for(i=0; i<(1 << PALETTEBITS); i++) {
+    dr = ((c >> 11) - (palette[i] >> 11)) * 2;
+    dg = ((c >> 5) & 0x3F) - ((palette[i] >> 5) & 0x3F);
+    db = ((c & 0x1F) - (palette[i] & 0x1F)) * 2;
+    d  = dr * dr + dg * dg + db * db;
+    if(d < bestd) {
+      bestd = d;
+      best  = i;
+    }
+  }
+  return best;
+}
+
+// Palette mode frame buffer: each column of a row pair takes
+// 2 * PALETTEBITS bits, the upper half's index then the lower's, low
+// bits first.  x,y are raw panel coordinates.
+static void RGBmatrixPanel_setIndex(int16_t x, int16_t y, uint8_t i) {
+  uint8_t half = (y >= nRows), r = y - half * nRows,
+          shift = ((x * 2 * PALETTEBITS) & 7) + half * PALETTEBITS,
+          *ptr = &matrixbuff[backindex][r * ROWBYTES + ((x * 2 * PALETTEBITS) >> 3)];
+  *ptr = (*ptr & ~(((1 << PALETTEBITS) - 1) << shift)) | (i << shift);
+  rowdirty[r] = 1;
+}
+
+static uint8_t RGBmatrixPanel_getIndex(int16_t x, int16_t y) {
+  uint8_t half = (y >= nRows), r = y - half * nRows,
+          shift = ((x * 2 * PALETTEBITS) & 7) + half * PALETTEBITS;
+  return (matrixbuff[backindex][r * ROWBYTES + ((x * 2 * PALETTEBITS) >> 3)]
+    >> shift) & ((1 << PALETTEBITS) - 1);
+}
+
+#define BYPIXEL true // No plane bytes to work on: every write is a pixel
+#else
+#define BYPIXEL (canvas16 != NULL)
+#endif
+
+// One raw pixel, for the by-pixel targets: a canvas, or in palette
+// mode the frame buffer.
+static inline void RGBmatrixPanel_rawPixel(int16_t x, int16_t y,
+  const RGBmatrixPanel_Pattern *p) {
+  if(canvas16) canvas16[y * WIDTH + x] = p->color;
+#ifdef PALETTEBITS
+  else RGBmatrixPanel_setIndex(x, y, p->index);
+#endif
+}
+
+// Work out, once per color, the packed bytes of a pixel: of each of a
+// column's PLANEBYTES bytes, the bits to keep and the bits to then set,
+// for the upper (half 0) and lower (half 1) halves of the display.
+void RGBmatrixPanel_makePattern(uint16_t c, RGBmatrixPanel_Pattern *p) {
+  uint8_t r, g, b, i, bits;
+
+  // RGBmatrixPanel_Adafruit_GFX uses 16-bit color in 5/6/5 format, while matrix needs
+  // nPlanes bits per channel.  Widen each to 8 bits (repeating its top
+  // bits, as Color333() etc. do) and keep the top nPlanes of them:
+  r = ((c >> 8) & 0xF8) | (c >> 13);         // RRRRRggggggbbbbb
+  g = ((c >> 3) & 0xFC) | ((c >> 9) & 0x03); // rrrrrGGGGGGbbbbb
+  b = ((c << 3) & 0xF8) | ((c >> 2) & 0x07); // rrrrrggggggBBBBB
+  r >>= 8 - nPlanes;
+  g >>= 8 - nPlanes;
+  b >>= 8 - nPlanes;
+  p->color = c;
+#ifdef PALETTEBITS
+  p->index = RGBmatrixPanel_paletteIndex(c);
+#endif
+
+  // Each byte holds one plane, WIDTH bytes apart.  Data for the upper
+  // half of the display is stored in bits 2-4 (R,G,B), the lower half
+  // in bits 5-7, so it can be quickly copied to the DATAPORT register
+  // w/6 output lines.  Byte 0 is plane 0 unless plane 0 is packed
+  // (below), in which case the bytes start at plane 1.
+  for(i=0; i<PLANEBYTES; i++) {
+    uint8_t n = i + nPlanes - PLANEBYTES;
+    bits = ((r >> n) & 1) | (((g >> n) & 1) << 1) | (((b >> n) & 1) << 2);
+    p->keep[0][i] = ~0b00011100;
+    p->set[0][i]  = bits << 2;
+    p->keep[1][i] = (uint8_t)~0b11100000;
+    p->set[1][i]  = bits << 5;
+  }
+#if PLANEBYTES < nPlanes
+  // Plane 0 is a tricky case -- its data is spread about, stored in
+  // the least two bits not used by the other planes.
+  // Upper half: R,G in byte 2 bits 0,1; B in byte 1 bit 0.
+  p->keep[0][1] &= ~0b00000001; p->set[0][1] |= (b & 1);
+  p->keep[0][2] &= ~0b00000011; p->set[0][2] |= (r & 1) | ((g & 1) << 1);
+  // Lower half: G,B in byte 0 bits 0,1; R in byte 1 bit 1.
+  p->keep[1][0] &= ~0b00000011; p->set[1][0] |= (g & 1) | ((b & 1) << 1);
+  p->keep[1][1] &= ~0b00000010; p->set[1][1] |= (r & 1) << 1;
+#endif
+}
+
+const RGBmatrixPanel_Pattern *RGBmatrixPanel_colorPattern(uint16_t c) {
+  if(!cachedvalid || (c != cachedcolor)) {
+    RGBmatrixPanel_makePattern(c, &cachedpattern);
+    cachedcolor = c;
+    cachedvalid = true;
+  }
+  return &cachedpattern;
 }
 
 void RGBmatrixPanel_drawPixel(int16_t x, int16_t y, uint16_t c) {
-  uint8_t r, g, b, bit, limit, *ptr;
+  if((x < 0) || (x >= _width) || (y < 0) || (y >= _height)) return;
+  RGBmatrixPanel_drawPixelPattern(x, y, RGBmatrixPanel_colorPattern(c));
+}
+
+// Same as RGBmatrixPanel_drawPixel(), for a color already turned into
+// a pattern: only the masked stores remain.
+void RGBmatrixPanel_drawPixelPattern(int16_t x, int16_t y,
+  const RGBmatrixPanel_Pattern *p) {
+  uint8_t i, half, *ptr;
 
   if((x < 0) || (x >= _width) || (y < 0) || (y >= _height)) return;
 
@@ -1702,70 +2317,763 @@ void RGBmatrixPanel_drawPixel(int16_t x, int16_t y, uint16_t c) {
     break;
   }
 
-  // RGBmatrixPanel_Adafruit_GFX uses 16-bit color in 5/6/5 format, while matrix needs
-  // 4/4/4.  Pluck out relevant bits while separating into R,G,B:
-  r =  c >> 12;        // RRRRrggggggbbbbb
-  g = (c >>  7) & 0xF; // rrrrrGGGGggbbbbb
-  b = (c >>  1) & 0xF; // rrrrrggggggBBBBb
-
-  // Loop counter stuff
-  bit   = 2;
-  limit = 1 << nPlanes;
-
-  if(y < nRows) {
-    // Data for the upper half of the display is stored in the lower
-    // bits of each byte.
-    ptr = &matrixbuff[backindex][y * WIDTH * (nPlanes - 1) + x]; // Base addr
-    // Plane 0 is a tricky case -- its data is spread about,
-    // stored in least two bits not used by the other planes.
-    ptr[WIDTH*2] &= ~0b00000011;           // Plane 0 R,G mask out in one op
-    if(r & 1) ptr[WIDTH*2] |= 0b00000001; // Plane 0 R: 64 bytes ahead, bit 0
-    if(g & 1) ptr[WIDTH*2] |= 0b00000010; // Plane 0 G: 64 bytes ahead, bit 1
-    if(b & 1) ptr[WIDTH]   |= 0b00000001; // Plane 0 B: 32 bytes ahead, bit 0
-    else      ptr[WIDTH]   &= ~0b00000001; // Plane 0 B unset; mask out
-    // The remaining three image planes are more normal-ish.
-    // Data is stored in the high 6 bits so it can be quickly
-    // copied to the DATAPORT register w/6 output lines.
-    for(; bit < limit; bit <<= 1) {
-      *ptr &= ~0b00011100;            // Mask out R,G,B in one op
-      if(r & bit) *ptr |= 0b00000100; // Plane N R: bit 2
-      if(g & bit) *ptr |= 0b00001000; // Plane N G: bit 3
-      if(b & bit) *ptr |= 0b00010000; // Plane N B: bit 4
-      ptr  += WIDTH;                 // Advance to next bit plane
+  if(BYPIXEL) {
+    RGBmatrixPanel_rawPixel(x, y, p);
+    return;
+  }
+
+  half = (y >= nRows);
+  if(half) y -= nRows;
+  rowdirty[y] = 1;
+  ptr = &matrixbuff[backindex][y * WIDTH * PLANEBYTES + x]; // Base addr
+  for(i=0; i<PLANEBYTES; i++, ptr += WIDTH) { // Advance to next bit plane
+    *ptr = (*ptr & p->keep[half][i]) | p->set[half][i];
+  }
+}
+
+// Up to 8 pixels down from (x,y), one per bit of 'bits' (LSB at top),
+// as in a glcdfont.c column: set bits in pattern fg, clear bits in bg,
+// or left alone if bg is NULL.  The column is clipped and mapped to the
+// panel once, then each pixel is just its masked stores.
+void RGBmatrixPanel_drawColumnPattern(int16_t x, int16_t y, uint8_t bits,
+  uint8_t n, const RGBmatrixPanel_Pattern *fg,
+  const RGBmatrixPanel_Pattern *bg) {
+  const RGBmatrixPanel_Pattern *p;
+  uint16_t rowbytes = WIDTH * PLANEBYTES;
+  uint8_t  i, r, half, *base, *ptr;
+  int8_t   dx = 0, dy = 0;
+
+  if(!n || (x < 0) || (x >= _width)) return;
+  if(y < 0) { // Clip top
+    if(-y >= n) return;
+    bits >>= -y;
+    n     += y;
+    y      = 0;
+  }
+  if(y + n > _height) { // Clip bottom
+    if(y >= _height) return;
+    n = _height - y;
+  }
+
+  // Same mapping as RGBmatrixPanel_drawPixel(); down the column is then
+  // one step along a raw column (0,2) or along a raw row (1,3).
+  switch(rotation) {
+   case 0:
+    dy = 1;
+    break;
+   case 1:
+    _swap_int16_t(x, y);
+    x  = WIDTH  - 1 - x;
+    dx = -1;
+    break;
+   case 2:
+    x  = WIDTH  - 1 - x;
+    y  = HEIGHT - 1 - y;
+    dy = -1;
+    break;
+   case 3:
+    _swap_int16_t(x, y);
+    y  = HEIGHT - 1 - y;
+    dx = 1;
+    break;
+  }
+
+  if(BYPIXEL) {
+    for(;;) {
+      p = (bits & 1) ? fg : bg;
+      if(p) RGBmatrixPanel_rawPixel(x, y, p);
+      bits >>= 1;
+      if(!--n || (!bits && !bg)) return;
+      x += dx;
+      y += dy;
     }
-  } else {
-    // Data for the lower half of the display is stored in the upper
-    // bits, except for the plane 0 stuff, using 2 least bits.
-    ptr = &matrixbuff[backindex][(y - nRows) * WIDTH * (nPlanes - 1) + x];
-    *ptr &= ~0b00000011;                  // Plane 0 G,B mask out in one op
-    if(r & 1)  ptr[WIDTH] |= 0b00000010; // Plane 0 R: 32 bytes ahead, bit 1
-    else       ptr[WIDTH] &= ~0b00000010; // Plane 0 R unset; mask out
-    if(g & 1) *ptr        |= 0b00000001; // Plane 0 G: bit 0
-    if(b & 1) *ptr        |= 0b00000010; // Plane 0 B: bit 0
-    for(; bit < limit; bit <<= 1) {
-      *ptr &= ~0b11100000;            // Mask out R,G,B in one op
-      if(r & bit) *ptr |= 0b00100000; // Plane N R: bit 5
-      if(g & bit) *ptr |= 0b01000000; // Plane N G: bit 6
-      if(b & bit) *ptr |= 0b10000000; // Plane N B: bit 7
-      ptr  += WIDTH;                 // Advance to next bit plane
+  }
+
+  half = (y >= nRows);
+  r    = y - half * nRows;
+  base = matrixbuff[backindex] + x;
+  ptr  = base + r * rowbytes;
+  rowdirty[r] = 1;
+  for(;;) {
+    p = (bits & 1) ? fg : bg;
+    if(p) {
+      for(i=0; i<PLANEBYTES; i++) {
+        ptr[i * WIDTH] = (ptr[i * WIDTH] & p->keep[half][i]) | p->set[half][i];
+      }
+    }
+    bits >>= 1;
+    if(!--n || (!bits && !bg)) break; // Nothing more to draw?
+    if(dx) {
+      ptr += dx;
+    } else if(dy > 0) {
+      if(++r == nRows) { // Into the lower half
+        r    = 0;
+        half = 1;
+        ptr  = base;
+      } else {
+        ptr += rowbytes;
+      }
+      rowdirty[r] = 1;
+    } else {
+      if(r-- == 0) { // Into the upper half
+        r    = nRows - 1;
+        half = 0;
+        ptr  = base + r * rowbytes;
+      } else {
+        ptr -= rowbytes;
+      }
+      rowdirty[r] = 1;
     }
   }
 }
 
 void RGBmatrixPanel_fillScreen(uint16_t c) {
-  if((c == 0x0000) || (c == 0xffff)) {
+  if(!BYPIXEL && ((c == 0x0000) || (c == 0xffff))) {
     // For black or white, all bits in frame buffer will be identically
     // RGBmatrixPanel_set or unset (regardless of weird bit packing), so it's OK to just
     // quickly memset the whole thing:
-    memset(matrixbuff[backindex], c, WIDTH * nRows * 3);
+    memset(matrixbuff[backindex], c, nRows * ROWBYTES);
+    memset(rowdirty, 1, nRows);
   } else {
     // Otherwise, need to handle it the long way:
     RGBmatrixPanel_fillRect(0, 0, _width, _height, c);
   }
 }
 
-// Return address of back buffer -- can then load/store data directly
+// Fill a rectangle straight into the packed bit planes: the color
+// pattern is worked out once, then each span is a run of masked byte stores per
+// plane, rather than a full RGBmatrixPanel_drawPixel() per pixel.
+void RGBmatrixPanel_fillRect(int16_t x, int16_t y, int16_t w, int16_t h,
+  uint16_t c) {
+  RGBmatrixPanel_fillRectPattern(x, y, w, h, RGBmatrixPanel_colorPattern(c));
+}
+
+// As RGBmatrixPanel_fillRect(), with the color already made into a
+// pattern; callers alternating between colors keep one of each.
+void RGBmatrixPanel_fillRectPattern(int16_t x, int16_t y, int16_t w,
+  int16_t h, const RGBmatrixPanel_Pattern *p) {
+  uint8_t  half, i, k, s, *ptr;
+  int16_t  x1, y1, t, n;
+
+  // Clip against the rotated display
+  x1 = x + w;
+  y1 = y + h;
+  if(x  < 0)       x  = 0;
+  if(y  < 0)       y  = 0;
+  if(x1 > _width)  x1 = _width;
+  if(y1 > _height) y1 = _height;
+  if((x >= x1) || (y >= y1)) return;
+
+  // Same mapping as RGBmatrixPanel_drawPixel(), applied to the corners;
+  // a rectangle stays a rectangle in raw panel coordinates.
+  switch(rotation) {
+   case 1:
+    t = x; x = WIDTH - y1; y1 = x1; x1 = WIDTH - y; y = t;
+    break;
+   case 2:
+    t = x; x = WIDTH  - x1; x1 = WIDTH  - t;
+    t = y; y = HEIGHT - y1; y1 = HEIGHT - t;
+    break;
+   case 3:
+    t = x; x = y; y = HEIGHT - x1; x1 = y1; y1 = HEIGHT - t;
+    break;
+  }
+
+  if(canvas16) {
+    for(; y < y1; y++) {
+      uint16_t *c = &canvas16[y * WIDTH];
+      for(n=x; n<x1; n++) c[n] = p->color;
+    }
+    return;
+  }
+#ifdef PALETTEBITS
+  for(; y < y1; y++) {
+    for(n=x; n<x1; n++) RGBmatrixPanel_setIndex(n, y, p->index);
+  }
+  return;
+#endif
+
+  for(; y < y1; y++) {
+    half = (y >= nRows);
+    rowdirty[y - half * nRows] = 1;
+    ptr  = &matrixbuff[backindex][(y - half * nRows) * WIDTH * PLANEBYTES + x];
+    for(i=0; i<PLANEBYTES; i++, ptr += WIDTH) {
+      k = p->keep[half][i];
+      s = p->set[half][i];
+      for(n=0; n<x1-x; n++) ptr[n] = (ptr[n] & k) | s;
+    }
+  }
+}
+
+#ifndef PALETTEBITS
+// Copy raw panel row src over raw row dst (both 0 to HEIGHT-1) in the
+// back buffer, all planes.  Each byte holds a pixel of both halves, so
+// only the destination half's bits are replaced; between halves, the
+// R,G,B bits move up or down 3 and plane 0's packed bits are remapped.
+static void RGBmatrixPanel_copyRow(int16_t dst, int16_t src) {
+  uint8_t  sh = (src >= nRows), dh = (dst >= nRows),
+           sm = sh ? 0b11100000 : 0b00011100,
+           dm = dh ? 0b11100000 : 0b00011100, v;
+  uint8_t *s  = &matrixbuff[backindex][(src - sh * nRows) * WIDTH * PLANEBYTES],
+          *d  = &matrixbuff[backindex][(dst - dh * nRows) * WIDTH * PLANEBYTES];
+  uint16_t n;
+
+  for(n=0; n<WIDTH*PLANEBYTES; n++) {
+    v = s[n] & sm;
+    if(sh != dh) v = sh ? (v >> 3) : (v << 3);
+    d[n] = (d[n] & ~dm) | v;
+  }
+#if PLANEBYTES < nPlanes
+  // Plane 0, as in RGBmatrixPanel_makePattern(): upper half R,G in
+  // byte 2 bits 0,1 and B in byte 1 bit 0; lower half G,B in byte 0
+  // bits 0,1 and R in byte 1 bit 1.
+  uint8_t *s1 = s + WIDTH, *d1 = d + WIDTH, *s2 = s1 + WIDTH, *d2 = d1 + WIDTH,
+           r, g, b;
+  for(n=0; n<WIDTH; n++) {
+    if(sh) {
+      r = (s1[n] >> 1) & 1; g = s[n] & 1; b = (s[n] >> 1) & 1;
+    } else {
+      r = s2[n] & 1; g = (s2[n] >> 1) & 1; b = s1[n] & 1;
+    }
+    if(dh) {
+      d[n]  = (d[n]  & ~0b00000011) | g | (b << 1);
+      d1[n] = (d1[n] & ~0b00000010) | (r << 1);
+    } else {
+      d2[n] = (d2[n] & ~0b00000011) | r | (g << 1);
+      d1[n] = (d1[n] & ~0b00000001) | b;
+    }
+  }
+#endif
+}
+#endif
+
+// Shift the back buffer (or canvas) contents dx pixels right and dy
+// pixels down (negative for left and up), in current rotation
+// coordinates, without redrawing: a horizontal step on the panel is one
+// memmove per plane row, as both halves of a byte move together; a
+// vertical one moves bits between rows.  The strip left behind is
+// filled with color c, ready for the new column(s) or row(s) to be
+// drawn into, e.g. at x = _width - 1 for a one pixel step left.
+void RGBmatrixPanel_scroll(int16_t dx, int16_t dy, uint16_t c) {
+  int16_t  rx, ry, y, n;
+
+  switch(rotation) { // Map the move to raw panel directions
+   case 0: rx =  dx; ry =  dy; break;
+   case 1: rx = -dy; ry =  dx; break;
+   case 2: rx = -dx; ry = -dy; break;
+   default:rx =  dy; ry = -dx; break;
+  }
+
+  if(canvas16) { // Plain rows of pixels: just move them
+    n = (rx > 0) ? rx : -rx;
+    if(rx && (n < WIDTH)) {
+      for(y=0; y<HEIGHT; y++) {
+        uint16_t *row = &canvas16[y * WIDTH];
+        if(rx > 0) memmove(row + n, row, (WIDTH - n) * 2);
+        else       memmove(row, row + n, (WIDTH - n) * 2);
+      }
+    }
+    n = (ry > 0) ? ry : -ry;
+    if(ry && (n < HEIGHT)) {
+      if(ry > 0) memmove(canvas16 + n * WIDTH, canvas16, (HEIGHT - n) * WIDTH * 2);
+      else       memmove(canvas16, canvas16 + n * WIDTH, (HEIGHT - n) * WIDTH * 2);
+    }
+  } else {
+#ifdef PALETTEBITS
+    // Indices move one at a time, from the far end of the move
+    int16_t x, sx, sy, t;
+    for(n=0; n<HEIGHT; n++) {
+      y = (ry > 0) ? (HEIGHT - 1 - n) : n;
+      for(x=0; x<WIDTH; x++) {
+        t  = (rx > 0) ? (WIDTH - 1 - x) : x;
+        sx = t - rx;
+        sy = y - ry;
+        if((sx >= 0) && (sx < WIDTH) && (sy >= 0) && (sy < HEIGHT))
+          RGBmatrixPanel_setIndex(t, y, RGBmatrixPanel_getIndex(sx, sy));
+      }
+    }
+#else
+    uint8_t *ptr;
+    if(rx && (rx > -WIDTH) && (rx < WIDTH)) {
+      n   = (rx > 0) ? rx : -rx;
+      ptr = matrixbuff[backindex];
+      for(y=0; y<nRows*PLANEBYTES; y++, ptr += WIDTH) {
+        if(rx > 0) memmove(ptr + n, ptr, WIDTH - n);
+        else       memmove(ptr, ptr + n, WIDTH - n);
+      }
+    }
+    if(ry > 0) {
+      for(y=HEIGHT-1; y>=ry; y--) RGBmatrixPanel_copyRow(y, y - ry);
+    } else if(ry < 0) {
+      for(y=0; y<HEIGHT+ry; y++) RGBmatrixPanel_copyRow(y, y - ry);
+    }
+#endif
+    memset(rowdirty, 1, nRows);
+  }
+
+  // Fill what was uncovered (all of it, for a move of a whole screen)
+  if(dx > 0)      RGBmatrixPanel_fillRect(0, 0, dx, _height, c);
+  else if(dx < 0) RGBmatrixPanel_fillRect(_width + dx, 0, -dx, _height, c);
+  if(dy > 0)      RGBmatrixPanel_fillRect(0, 0, _width, dy, c);
+  else if(dy < 0) RGBmatrixPanel_fillRect(0, _height + dy, _width, -dy, c);
+}
+
+// CANVAS ------------------------------------------------------------------
+
+// Send all drawing to a 5-6-5 canvas of WIDTH * HEIGHT pixels, in raw
+// panel order (rotation is applied on the way in, as for the panel),
+// or with NULL back to the back buffer.  Each pixel is then a single
+// 16-bit store; RGBmatrixPanel_convertCanvas() brings it to the panel.
+// At 2 bytes a pixel this is for parts with RAM to spare.
+void RGBmatrixPanel_setCanvas(uint16_t *buf) {
+  canvas16 = buf;
+}
+
+#ifndef __AVR__
+// Bit n of v to bit 0 of byte n: with the 6 channel values of a column
+// spread out and shifted into place, each byte of the sum is that
+// column's port bits for one plane -- every plane at once, in 64 bits.
+static inline uint64_t RGBmatrixPanel_spread(uint8_t v) {
+  return (((v * 0x0101010101010101ULL) & 0x8040201008040201ULL) +
+    0x7F7F7F7F7F7F7F7FULL) >> 7 & 0x0101010101010101ULL;
+}
+#endif
+
+// Convert a rectangle (current rotation coordinates) of a canvas into
+// the back buffer, a column of both display halves at a time.  Where
+// the rectangle covers both halves of a row pair the plane bytes are
+// simply stored; otherwise only that half's bits are replaced.
+void RGBmatrixPanel_convertCanvas(const uint16_t *buf, int16_t x, int16_t y,
+  int16_t w, int16_t h) {
+  int16_t  x1 = x + w, y1 = y + h, t, n;
+
+  if(x  < 0)       x  = 0;
+  if(y  < 0)       y  = 0;
+  if(x1 > _width)  x1 = _width;
+  if(y1 > _height) y1 = _height;
+  if((x >= x1) || (y >= y1)) return;
+  switch(rotation) { // As in RGBmatrixPanel_fillRect()
+   case 1:
+    t = x; x = WIDTH - y1; y1 = x1; x1 = WIDTH - y; y = t;
+    break;
+   case 2:
+    t = x; x = WIDTH  - x1; x1 = WIDTH  - t;
+    t = y; y = HEIGHT - y1; y1 = HEIGHT - t;
+    break;
+   case 3:
+    t = x; x = y; y = HEIGHT - x1; x1 = y1; y1 = HEIGHT - t;
+    break;
+  }
+
+#ifdef PALETTEBITS
+  // Palette mode: each pixel to its nearest entry
+  for(; y<y1; y++) {
+    for(n=x; n<x1; n++) {
+      RGBmatrixPanel_setIndex(n, y,
+        RGBmatrixPanel_colorPattern(buf[y * WIDTH + n])->index);
+    }
+  }
+#else
+  int16_t  r;
+  uint8_t  keep[PLANEBYTES], bits[8], i, top, bottom, *ptr;
+  uint16_t c;
+  for(r=0; r<nRows; r++) {
+    top    = (r >= y) && (r < y1);
+    bottom = (r + nRows >= y) && (r + nRows < y1);
+    if(!top && !bottom) continue;
+    rowdirty[r] = 1;
+
+    // Bits of each plane byte this pass leaves alone, as the
+    // RGBmatrixPanel_makePattern() keep masks
+    for(i=0; i<PLANEBYTES; i++) {
+      keep[i] = (top ? 0b11100011 : 0xFF) & (bottom ? 0b00011111 : 0xFF);
+    }
+#if PLANEBYTES < nPlanes
+    if(top)    { keep[1] &= ~0b00000001; keep[2] &= ~0b00000011; }
+    if(bottom) { keep[0] &= ~0b00000011; keep[1] &= ~0b00000010; }
+#endif
+
+    ptr = &matrixbuff[backindex][r * WIDTH * PLANEBYTES];
+    for(n=x; n<x1; n++) {
+      // Top nPlanes bits of each channel, widened as in makePattern()
+      uint8_t v[6];
+      for(i=0; i<2; i++) {
+        c = buf[(r + i * nRows) * WIDTH + n];
+        v[i*3]   = (((c >> 8) & 0xF8) | (c >> 13))         >> (8 - nPlanes);
+        v[i*3+1] = (((c >> 3) & 0xFC) | ((c >> 9) & 0x03)) >> (8 - nPlanes);
+        v[i*3+2] = (((c << 3) & 0xF8) | ((c >> 2) & 0x07)) >> (8 - nPlanes);
+      }
+#ifndef __AVR__
+      uint64_t planes = 0;
+      for(i=0; i<6; i++) planes |= RGBmatrixPanel_spread(v[i]) << (i + 2);
+      for(i=0; i<nPlanes; i++) bits[i] = planes >> (i * 8);
+#else
+      for(i=0; i<nPlanes; i++) {
+        bits[i] = ((( v[0] >> i) & 1) << 2) | (((v[1] >> i) & 1) << 3) |
+                  ((( v[2] >> i) & 1) << 4) | (((v[3] >> i) & 1) << 5) |
+                  ((( v[4] >> i) & 1) << 6) | (((v[5] >> i) & 1) << 7);
+      }
+#endif
+      // bits[p] is plane p's port byte for the column; lay out the
+      // plane bytes from it (plane 0 packed, with 4 or more planes)
+      uint8_t out[PLANEBYTES];
+      for(i=0; i<PLANEBYTES; i++) out[i] = bits[i + nPlanes - PLANEBYTES];
+#if PLANEBYTES < nPlanes
+      out[0] |= bits[0] >> 6;                            // Lower G,B
+      out[1] |= ((bits[0] >> 4) & 1) | ((bits[0] >> 4) & 2); // Upper B, lower R
+      out[2] |= (bits[0] >> 2) & 3;                      // Upper R,G
+#endif
+      // Both halves: every bit of the bytes is this pixel pair's (bits
+      // 0-1 unused, or packed plane 0), so they're simply stored
+      if(top && bottom) {
+        for(i=0; i<PLANEBYTES; i++) ptr[i * WIDTH + n] = out[i];
+      } else {
+        for(i=0; i<PLANEBYTES; i++) {
+          ptr[i * WIDTH + n] = (ptr[i * WIDTH + n] & keep[i]) | (out[i] & ~keep[i]);
+        }
+      }
+    }
+  }
+#endif
+}
+
+// LAYERS ------------------------------------------------------------------
+
+// Start a layer stack: background, then the sprites (fields filled in
+// by the caller, bottom one first), no text.  The whole display is due
+// for drawing at the first RGBmatrixPanel_layersCompose().
+void RGBmatrixPanel_layersInit(RGBmatrixPanel_Layers *l,
+  RGBmatrixPanel_Sprite *sprites, uint8_t n, uint16_t bgcolor,
+  const uint16_t *bgbitmap) {
+  l->bgcolor  = bgcolor;
+  l->bgbitmap = bgbitmap;
+  l->sprite   = sprites;
+  l->nsprites = n;
+  l->text     = NULL;
+  l->ndirty   = 0;
+  while(n--) sprites[n].shown = false;
+  RGBmatrixPanel_layersDirty(l, 0, 0, _width, _height);
+}
+
+// Mark an area for redrawing at the next RGBmatrixPanel_layersCompose(),
+// e.g. after changing the background there.  Touching or overlapping
+// areas are merged; when the list is full, the new area joins the one
+// whose bounds it grows least.
+void RGBmatrixPanel_layersDirty(RGBmatrixPanel_Layers *l, int16_t x,
+  int16_t y, int16_t w, int16_t h) {
+  RGBmatrixPanel_Rect *r;
+  int16_t  x1 = x + w, y1 = y + h;
+  int32_t  grow, best = 0x7FFFFFFF;
+  uint8_t  i, bi = 0;
+
+  if(x  < 0)       x  = 0;
+  if(y  < 0)       y  = 0;
+  if(x1 > _width)  x1 = _width;
+  if(y1 > _height) y1 = _height;
+  if((x >= x1) || (y >= y1)) return;
+
+  for(;;) {
+    for(i=0; i<l->ndirty; i++) {
+      r = &l->dirty[i];
+      if((x <= r->x + r->w) && (r->x <= x1) &&
+         (y <= r->y + r->h) && (r->y <= y1)) break; // Touching
+    }
+    if(i == l->ndirty) {
+      if(i < LAYERDIRTY) break; // Room for it as it is
+      for(i=0; i<l->ndirty; i++) {
+        r    = &l->dirty[i];
+        grow = (int32_t)(max(x1, r->x + r->w) - min(x, r->x)) *
+                        (max(y1, r->y + r->h) - min(y, r->y)) -
+               (int32_t)r->w * r->h;
+        if(grow < best) {
+          best = grow;
+          bi   = i;
+        }
+      }
+      i = bi;
+    }
+    // Take rect i out of the list, grow the new one over it and retry:
+    // the union may now touch others.
+    r  = &l->dirty[i];
+    if(r->x < x)               x  = r->x;
+    if(r->y < y)               y  = r->y;
+    if(r->x + r->w > x1)       x1 = r->x + r->w;
+    if(r->y + r->h > y1)       y1 = r->y + r->h;
+    *r = l->dirty[--l->ndirty];
+  }
+  r    = &l->dirty[l->ndirty++];
+  r->x = x;
+  r->y = y;
+  r->w = x1 - x;
+  r->h = y1 - y;
+}
+
+// Set (or with t NULL, remove) the text overlay: a layout drawn in one
+// color with its origin at (x,y).  Old and new text areas are redrawn.
+void RGBmatrixPanel_layersText(RGBmatrixPanel_Layers *l,
+  const RGBmatrixPanel_TextLayout *t, int16_t x, int16_t y, uint16_t color) {
+  if(l->text) {
+    RGBmatrixPanel_layersDirty(l, l->textx + l->text->x1,
+      l->texty + l->text->y1, l->text->w, l->text->h);
+  }
+  l->text      = t;
+  l->textx     = x;
+  l->texty     = y;
+  l->textcolor = color;
+  if(t) RGBmatrixPanel_layersDirty(l, x + t->x1, y + t->y1, t->w, t->h);
+}
+
+// A row of w PROGMEM 5-6-5 pixels at (x,y), written as runs of one
+// color, each a span fill.  Pixels whose mask bit is clear (counting
+// from bit 'bit' of mask, if not NULL) or, if keyed, that are the key
+// color are left alone.
+static void RGBmatrixPanel_layerRow(int16_t x, int16_t y, int16_t w,
+  const uint16_t *px, const uint8_t *mask, uint16_t bit, bool keyed,
+  uint16_t key) {
+  int16_t  i, start = 0;
+  uint16_t c = 0, runc = 0;
+  bool     run = false, on;
+
+  for(i=0; i<=w; i++, bit++) {
+    on = false;
+    if(i < w) {
+      c = pgm_read_word(&px[i]);
+      if(mask) on = pgm_read_byte(&mask[bit >> 3]) & (0x80 >> (bit & 7));
+      else     on = !keyed || (c != key);
+    }
+    if(run && (!on || (c != runc))) {
+      RGBmatrixPanel_fillRectPattern(x + start, y, i - start, 1,
+        RGBmatrixPanel_colorPattern(runc));
+      run = false;
+    }
+    if(on && !run) {
+      run   = true;
+      start = i;
+      runc  = c;
+    }
+  }
+}
+
+// Redraw whatever changed since the last call, into the back buffer:
+// sprites that moved, appeared, vanished or changed bitmap or size,
+// plus areas marked dirty.  Each dirty rectangle gets the background,
+// then the sprites over it (clipped to it) and the text; pixels
+// elsewhere are left alone, so the back buffer must still hold the last
+// composited frame -- single buffering, or swapBuffers(true).
+void RGBmatrixPanel_layersCompose(RGBmatrixPanel_Layers *l) {
+  RGBmatrixPanel_Sprite *s;
+  RGBmatrixPanel_Rect   *r;
+  int16_t  y, x0, y0, x1, y1;
+  uint8_t  i, n;
+
+  for(i=0; i<l->nsprites; i++) {
+    s = &l->sprite[i];
+    if(s->shown && (!s->visible || (s->x != s->shownx) ||
+       (s->y != s->showny) || (s->w != s->shownw) || (s->h != s->shownh) ||
+       (s->bitmap != s->shownbitmap))) {
+      RGBmatrixPanel_layersDirty(l, s->shownx, s->showny, s->shownw, s->shownh);
+      s->shown = false;
+    }
+    if(s->visible && !s->shown) {
+      RGBmatrixPanel_layersDirty(l, s->x, s->y, s->w, s->h);
+      s->shown       = true;
+      s->shownx      = s->x;
+      s->showny      = s->y;
+      s->shownw      = s->w;
+      s->shownh      = s->h;
+      s->shownbitmap = s->bitmap;
+    }
+  }
+
+  RGBmatrixPanel_startWrite();
+  for(n=0; n<l->ndirty; n++) {
+    r = &l->dirty[n];
+
+    // Background
+    if(l->bgbitmap) {
+      for(y=r->y; y<r->y+r->h; y++) {
+        RGBmatrixPanel_layerRow(r->x, y, r->w,
+          &l->bgbitmap[y * _width + r->x], NULL, 0, false, 0);
+      }
+    } else {
+      RGBmatrixPanel_fillRect(r->x, r->y, r->w, r->h, l->bgcolor);
+    }
+
+    // Sprites, bottom first, each cut to the rectangle
+    for(i=0; i<l->nsprites; i++) {
+      s = &l->sprite[i];
+      if(!s->visible) continue;
+      x0 = max(s->x, r->x);
+      y0 = max(s->y, r->y);
+      x1 = min(s->x + s->w, r->x + r->w);
+      y1 = min(s->y + s->h, r->y + r->h);
+      for(y=y0; y<y1; y++) {
+        RGBmatrixPanel_layerRow(x0, y, x1 - x0,
+          &s->bitmap[(y - s->y) * s->w + x0 - s->x],
+          s->mask ? &s->mask[(y - s->y) * ((s->w + 7) / 8)] : NULL,
+          x0 - s->x, s->keyed, s->key);
+      }
+    }
+
+    // Text, top of everything: cut to the rectangle's columns.  Text
+    // pixels above or below it are already shown in the same color.
+    if(l->text) {
+      RGBmatrixPanel_drawLayout(l->text, l->textx, l->texty, l->textcolor,
+        r->x, r->w);
+    }
+  }
+  RGBmatrixPanel_endWrite();
+  l->ndirty = 0;
+}
+
+// Compressed images, as made by extras/imageconvert.cpp: the frame
+// buffer bytes themselves (so, laid out for one nPlanes or PALETTEBITS
+// setting and panel size), run-length coded, each frame after the
+// first only as changes to the one before.  After an IMAGEHEADER byte
+// header, each frame is a series of codes filling nRows * ROWBYTES
+// bytes, each code a byte c:
+//   0x00-0x7F  c + 1 bytes follow, copied as they are
+//   0x80-0xBF  the next byte, repeated (c & 0x3F) + 2 times
+//   0xC0-0xFF  (c & 0x3F) + 1 bytes unchanged from the previous frame
+// Decoding is then memcpy_P() and memset() over spans of plane bytes,
+// not a color conversion per pixel.
+
+// Start playing image data (PROGMEM) from its first frame.  Returns
+// false if it was made for another panel size or frame buffer layout.
+bool RGBmatrixPanel_imageOpen(RGBmatrixPanel_Image *im, const uint8_t *data) {
+  if((pgm_read_byte(&data[0]) != WIDTH) ||
+     (pgm_read_byte(&data[1]) != HEIGHT) ||
+     (pgm_read_byte(&data[2]) != IMAGELAYOUT)) return false;
+  im->data   = data;
+  im->next   = data + IMAGEHEADER;
+  im->frames = pgm_read_byte(&data[3]) | (pgm_read_byte(&data[4]) << 8);
+  im->frame  = 0;
+  return im->frames > 0;
+}
+
+// Decode the next frame into the back buffer, returning its number;
+// after the last, play starts over.  Other frames than the first build
+// on the one before, so the back buffer has to still hold it: with
+// double buffering, swap with swapBuffers(true) (only the rows that
+// changed are copied).  Rotation and canvas don't apply.
+uint16_t RGBmatrixPanel_imageNext(RGBmatrixPanel_Image *im) {
+  const uint8_t *src = im->next;
+  uint8_t       *dst = matrixbuff[backindex];
+  uint16_t       pos = 0, end = nRows * ROWBYTES, rowend = ROWBYTES, n,
+                 shown = im->frame;
+  uint8_t        c, r = 0;
+
+  while(pos < end) {
+    c = pgm_read_byte(src++);
+    if(c < 0x80)      n = c + 1;
+    else if(c < 0xC0) n = (c & 0x3F) + 2;
+    else              n = (c & 0x3F) + 1;
+    if(n > end - pos) n = end - pos; // Bad data mustn't run off the end
+    if(c < 0xC0) {
+      if(c < 0x80) {
+        memcpy_P(&dst[pos], src, n);
+        src += c + 1;
+      } else {
+        memset(&dst[pos], pgm_read_byte(src++), n);
+      }
+      rowdirty[r] = 1; // Rows written need copying on the next swap
+      while(pos + n > rowend) {
+        rowdirty[++r] = 1;
+        rowend       += ROWBYTES;
+      }
+    }
+    pos += n;
+    while((pos >= rowend) && (pos < end)) {
+      r++;
+      rowend += ROWBYTES;
+    }
+  }
+
+  if(++im->frame >= im->frames) { // Loop; the first frame is whole
+    im->frame = 0;
+    src       = im->data + IMAGEHEADER;
+  }
+  im->next = src;
+  return shown;
+}
+
+// Packed bitmaps (extras/imageconvert.cpp -p) are a band of whole
+// panel-height columns in the frame buffer's own layout: after a
+// PACKEDHEADER byte header, for each row pair, its plane bytes'
+// lines (PLANEBYTES of them; one of index bytes in palette mode), each
+// the bitmap's width of columns.  Drawing one is then a memcpy_P() per
+// line, or a single one for a full screen image.
+#ifdef PALETTEBITS
+ #define PACKCOLS  (4 / PALETTEBITS) ///< Columns per frame buffer byte
+ #define PACKLINES 1                 ///< Lines of bytes per row pair
+#else
+ #define PACKCOLS  1
+ #define PACKLINES PLANEBYTES
+#endif
+
+// Copy packed bitmap bmp (PROGMEM) into the back buffer with its left
+// column at raw panel column x, clipped at the panel's sides; rotation
+// doesn't apply.  It replaces the full height of those columns.  In
+// palette mode its width is a multiple of PACKCOLS (imageconvert pads
+// it), and at an x that isn't, columns don't line up with bytes: it's
+// copied a column at a time then, slower than whole lines.  Returns
+// false, drawing nothing, if bmp was made for another panel height or
+// frame buffer layout, or is not a whole number of bytes wide.
+bool RGBmatrixPanel_drawPacked(const uint8_t *bmp, int16_t x) {
+  int16_t  w = pgm_read_byte(&bmp[0]), sx = 0, n = w;
+  uint8_t *dst;
+  uint16_t i;
+
+  if((pgm_read_byte(&bmp[1]) != HEIGHT) ||
+     (pgm_read_byte(&bmp[2]) != IMAGELAYOUT) || (w % PACKCOLS)) return false;
+#ifdef PALETTEBITS
+  if(x & (PACKCOLS - 1)) {
+    // Each column's index bits (both halves) in turn, as
+    // RGBmatrixPanel_setIndex() places them
+    uint8_t  bits = 2 * PALETTEBITS, m = (1 << bits) - 1, v, sh;
+    int16_t  c;
+    if((x >= WIDTH) || (x + w <= 0)) return true;
+    memset(rowdirty, 1, nRows);
+    bmp += PACKEDHEADER;
+    dst  = matrixbuff[backindex];
+    for(i=0; i<nRows; i++, bmp += w / PACKCOLS, dst += ROWBYTES) {
+      for(sx=0; sx<w; sx++) {
+        c = x + sx;
+        if((c < 0) || (c >= WIDTH)) continue;
+        v  = (pgm_read_byte(&bmp[sx / PACKCOLS]) >> ((sx % PACKCOLS) * bits)) & m;
+        sh = (c % PACKCOLS) * bits;
+        dst[c / PACKCOLS] = (dst[c / PACKCOLS] & ~(m << sh)) | (v << sh);
+      }
+    }
+    return true;
+  }
+#endif
+  if(x < 0) {
+    sx = -x;
+    n += x;
+    x  = 0;
+  }
+  if(x + n > WIDTH) n = WIDTH - x;
+  if(n <= 0) return true;
+  memset(rowdirty, 1, nRows);
+  bmp += PACKEDHEADER + sx / PACKCOLS;
+  dst  = matrixbuff[backindex] + x / PACKCOLS;
+  if(n == w && w == WIDTH) { // Full screen: the buffer in one go
+    memcpy_P(dst, bmp, nRows * ROWBYTES);
+    return true;
+  }
+  for(i=0; i<nRows * PACKLINES; i++) {
+    memcpy_P(dst, bmp, n / PACKCOLS);
+    bmp += w     / PACKCOLS;
+    dst += WIDTH / PACKCOLS;
+  }
+  return true;
+}
+
+// Return address of back buffer -- can then load/store data directly.
+// Any row may then change, so the next swapBuffers(true) copies all.
 uint8_t *RGBmatrixPanel_backBuffer() {
+  memset(rowdirty, 1, nRows);
   return matrixbuff[backindex];
 }
 
@@ -1775,17 +3083,92 @@ uint8_t *RGBmatrixPanel_backBuffer() {
 // be incrementally modified.  If "false", the back buffer then contains
 // the old front buffer contents -- your code can either clear this or
 // RGBmatrixPanel_draw over every pixel.  (No effect if double-buffering is not enabled.)
+// With triple buffering this never waits: the frame is queued for the
+// interrupt to pick up, replacing any it hasn't got to yet, and drawing
+// carries on in the third buffer ("false" leaves an older frame there).
 void RGBmatrixPanel_swapBuffers(bool copy) {
-  if(matrixbuff[0] != matrixbuff[1]) {
-    // To avoid 'tearing' display, actual swap takes place in the interrupt
-    // handler, at the end of a complete screen refresh cycle.
-    swapflag = true;                  // Set flag here, then...
-    while(swapflag == true) delay(1); // wait for interrupt to clear it
-    if(copy == true)
-      memcpy(matrixbuff[backindex], matrixbuff[1-backindex], WIDTH * nRows * 3);
+  while(RGBmatrixPanel_swapPending()) delay(1); // Finish any requestSwap()
+  if(RGBmatrixPanel_requestSwap(copy)) {
+    while(RGBmatrixPanel_swapPending()) delay(1); // Wait for interrupt
   }
 }
 
+// Non-blocking form of swapBuffers(): asks for the swap and returns at
+// once, so the next frame can be worked on (without drawing) or I/O
+// serviced meanwhile.  Poll swapPending() until it returns false before
+// drawing again; that call also does the copy, if one was asked for.
+// Returns false, doing nothing, if double-buffering is not enabled or
+// an earlier swap is still pending.
+bool RGBmatrixPanel_requestSwap(bool copy) {
+  if((matrixbuff[0] == matrixbuff[1]) || RGBmatrixPanel_swapPending())
+    return false;
+  if(triplebuf) {
+    uint8_t on = TIMSK & _BV(TOIE1), done = backindex;
+    TIMSK &= ~_BV(TOIE1); // The interrupt swaps readyindex too
+    backindex  = readyindex;
+    readyindex = done;
+    swapflag   = true;
+    TIMSK |= on;
+    // The buffer drawn into next holds some older frame, so a copy has
+    // to be whole, and without one any row may be stale.
+    if(copy) memcpy(matrixbuff[backindex], matrixbuff[done], nRows * ROWBYTES);
+    memset(rowdirty, !copy, nRows);
+    swapsaved = 0;
+    return true;
+  }
+  // To avoid 'tearing' display, actual swap takes place in the interrupt
+  // handler, at the end of a complete screen refresh cycle.
+  swapcopy = copy;
+  swapflag = true;
+  return true;
+}
+
+// True while a requested swap hasn't happened yet.  The first call after
+// the interrupt has done it brings the new back buffer up to date if
+// requestSwap(true) was used, after which it's safe to draw.
+bool RGBmatrixPanel_swapPending(void) {
+  if(triplebuf) return false;
+  if(swapflag == true) return true;
+  backindex = readyindex; // The old front buffer, after a swap
+  if(swapcopy == true) {
+    // Buffers were last made equal by a copy (or both start out
+    // clear), and every drawing call since marked the rows it touched;
+    // swapping doesn't change which rows differ.  Only those need
+    // copying.
+    uint16_t rowbytes = ROWBYTES;
+    uint8_t  r;
+    swapcopy  = false;
+    swapsaved = 0;
+    for(r=0; r<nRows; r++) {
+      if(rowdirty[r]) {
+        memcpy(&matrixbuff[backindex][r * rowbytes],
+               &matrixbuff[frontindex][r * rowbytes], rowbytes);
+        rowdirty[r] = 0;
+      } else {
+        swapsaved += rowbytes;
+      }
+    }
+  }
+  return false;
+}
+
+// Have fn() called from the interrupt handler right after each swap,
+// e.g. to set a flag or start the next frame's timing.  It runs with
+// interrupts off inside a display refresh, so must be very short.
+// NULL to remove.
+void RGBmatrixPanel_setSwapCallback(void (*fn)(void)) {
+  uint8_t on = TIMSK & _BV(TOIE1);
+  TIMSK &= ~_BV(TOIE1); // Pointer is 2 bytes; don't let the ISR see half
+  swapcallback = fn;
+  TIMSK |= on;
+}
+
+// Bytes the most recent swapBuffers(true) was spared copying, as the
+// rows they hold were unchanged.
+uint16_t RGBmatrixPanel_swapSaved(void) {
+  return swapsaved;
+}
+
 // -------------------- Interrupt handler stuff --------------------
 
 ISR(TIMER1_OVF_vect, ISR_BLOCK) { // ISR_BLOCK important -- see notes later
@@ -1807,6 +3190,24 @@ ISR(TIMER1_OVF_vect, ISR_BLOCK) { // ISR_BLOCK important -- see notes later
 // should different compilers produce slightly different results.
 #define CALLOVERHEAD 60   // Actual value measured = 56
 #define LOOPTIME     200  // Actual value measured = 188
+// With ISRSTATS, every call also notes its own timing after the data
+// is out (estimated from the code, not measured).  That runs with the
+// shortest interval already started, so the interval has to cover it.
+#if ISRSTATS
+#define STATSTIME    24
+#else
+#define STATSTIME    0
+#endif
+// The interleaved scan spends SCANTIME more ticks per interrupt finding
+// its row (estimated from the code, not measured), so its shortest
+// interval is stretched by that much.  BLANKTIME is extra LEDs-off time
+// on each of its row changes, letting the row drivers settle before
+// output is re-enabled (see below); the interval is lengthened to
+// match, so brightness holds.
+#define SCANTIME     48
+#ifndef BLANKTIME
+#define BLANKTIME    24
+#endif
 // The "on" time for bitplane 0 (with the shortest BCM interval) can
 // then be estimated as LOOPTIME + CALLOVERHEAD * 2.  Each successive
 // bitplane then doubles the prior amount of time.  We can then
@@ -1831,6 +3232,75 @@ ISR(TIMER1_OVF_vect, ISR_BLOCK) { // ISR_BLOCK important -- see notes later
 // 16x32 matrix uses about half that CPU load.  CPU time could be
 // further adjusted by padding the LOOPTIME value, but refresh rates
 // will decrease proportionally, and 200 Hz is a decent target.
+// The above is for the default 4 planes.  Each plane more doubles the
+// ticks per row (so halves the refresh rate), each plane less about
+// halves them.  With fewer than 4 planes nothing is packed and plane 0
+// goes out like the others, in 188 ticks rather than 920.  At 8
+// planes the 16x32 matrix's doubled LOOPTIME would overflow the 16-bit
+// timer, so it then runs at the 32x32 timing like the rest.
+// extras/isrcost.cpp runs this handler in the host simulator and redoes
+// the above for every panel size and F_CPU.  The ISRTICKS() notes below
+// give it the AVR cost of each path; keep them in step with the code.
+
+#ifndef ISRTICKS
+#define ISRTICKS(n) // Cost annotation, only counted by the host build
+#endif
+
+#ifdef PALETTEBITS
+// Palette mode's row source: each index byte holds a column or two's
+// upper and lower half indices, and paletteport has the port bytes of
+// every pair, plane by plane.
+static void RGBmatrixPanel_paletteRow(uint8_t r, uint8_t *dst) {
+  const uint8_t *src = matrixbuff[frontindex] + r * ROWBYTES, *port;
+  uint8_t        bits = 0, i, p;
+
+  for(i=0; i<WIDTH; i++, dst++) {
+    if(!(i % (4 / PALETTEBITS))) bits = *src++; // Next index byte
+    port   = paletteport[bits & ((1 << (2 * PALETTEBITS)) - 1)];
+    bits >>= 2 * PALETTEBITS;
+    for(p=0; p<nPlanes; p++) dst[p * WIDTH] = port[p];
+  }
+  ISRTICKS(WIDTH * (10 + 4 * nPlanes)); // Estimated, not measured
+}
+#endif
+
+// Have the interrupt show frames kept in a format of the caller's own
+// (run-length coded, 1 bit per pixel, generated on the fly...) rather
+// than matrixbuff.  Once per row, while the previous row's longest
+// plane is shown, fn(r, dst) fills dst with row pair r as it goes out
+// DATAPORT: nPlanes runs of WIDTH bytes, plane 0 and the leftmost
+// column first, each byte's bits 2-4 the R,G,B bits of the upper half's
+// pixel and bits 5-7 the lower half's.  fn() runs inside the interrupt
+// and must fit in that plane's interval -- extras/isrcost.cpp shows how
+// many ticks there are.  The interleaved scan is off while a source is
+// set; set while it's on, the source takes over at the top of the next
+// frame, as rows out of order can't switch part way.  NULL goes back to
+// scanning the frame buffer (in palette mode, through its own row
+// source).
+void RGBmatrixPanel_setRowSource(void (*fn)(uint8_t r, uint8_t *dst)) {
+  uint8_t on = TIMSK & _BV(TOIE1);
+
+#ifdef PALETTEBITS
+  if(!fn) fn = RGBmatrixPanel_paletteRow;
+#endif
+  if(fn && !rowcache &&
+    (NULL == (rowcache = (uint8_t *)malloc(nPlanes * WIDTH)))) return;
+  TIMSK &= ~_BV(TOIE1);
+  rowpending = NULL;
+  if(fn && scaninterleave) {
+    rowpending = fn; // The interrupt switches over
+  } else if(fn) {
+    fn(row, rowcache); // Row the next interrupt may load a plane of
+    buffptr        = rowcache + (plane + 1) * WIDTH; // ...and that plane
+    scaninterleave = false;
+  } else if(rowsource) {
+    // Pick the scan of matrixbuff up where the next interrupt expects
+    buffptr = matrixbuff[frontindex] + row * ROWBYTES +
+      (plane + 1 - (nPlanes - PLANEBYTES)) * WIDTH;
+  }
+  rowsource = fn;
+  TIMSK |= on;
+}
 
 // The flow of the interrupt can be awkward to grasp, because data is
 // being issued to the LED matrix for the *next* bitplane and/or row
@@ -1838,8 +3308,12 @@ ISR(TIMER1_OVF_vect, ISR_BLOCK) { // ISR_BLOCK important -- see notes later
 // counter variables change between past/present/future tense in mid-
 // function...hopefully tenses are sufficiently commented.
 void RGBmatrixPanel_updateDisplay(void) {
-  uint8_t  i, tick, tock, *ptr;
+  uint8_t  i, tick, tock, *ptr, addr = 0xFF;
+  bool     newframe = false;
   uint16_t t, duration;
+#if ISRSTATS
+  uint16_t entry = TCNT1;     // Ticks since the overflow
+#endif
 
   OE_PORT  |= (1 << OE_PIN);  // Disable LED output during row/plane switchover
   LAT_PORT |= (1 << LAT_PIN); // Latch data loaded during *prior* interrupt
@@ -1850,48 +3324,93 @@ void RGBmatrixPanel_updateDisplay(void) {
   // result because that time is implicit between the timer overflow
   // (interrupt triggered) and the RGBmatrixPanel_initial LEDs-off line at the start
   // of this method.
-  t = (nRows > 8) ? LOOPTIME : (LOOPTIME * 2);
+  t = ((nRows > 8) || (nPlanes > 7)) ?
+    (LOOPTIME + STATSTIME) : ((LOOPTIME + STATSTIME) * 2);
+  if(scaninterleave) t += SCANTIME;
   duration = ((t + CALLOVERHEAD * 2) << plane) - CALLOVERHEAD;
 
   // Borrowing a technique here from Ray's Logic:
   // www.rayslogic.com/propeller/Programming/AdafruitRGB/AdafruitRGB.htm
-  // This code cycles through all four planes for each scanline before
+  // This code cycles through all the planes for each scanline before
   // advancing to the next line.  While it might seem beneficial to
   // advance lines every time and interleave the planes to reduce
   // vertical scanning artifacts, in practice with this panel it causes
   // a green 'ghosting' effect on black pixels, a much worse artifact.
-
-  if(++plane >= nPlanes) {      // Advance plane counter.  Maxed out?
+  // begin(true) does it anyway, for camera-facing uses where the long
+  // dark gap of each row matters more: planes still go 0,1,2...  in
+  // turn (so plane 0 still unpacks during the longest interval), but
+  // each goes to a different row, spread nRows/nPlanes rows apart, and
+  // every row change gets BLANKTIME to settle to keep ghosting down.
+
+  if(scaninterleave) {
+    addr = row;                 // Row of the data latching now
+    if(++plane >= nPlanes) {    // Advance plane counter.  Maxed out?
+      plane = 0;                // Yes, reset to plane 0, and
+      if(++scanblock >= nRows) { // advance the frame position
+        scanblock = 0;
+        newframe  = true;
+      }
+    }
+    row = scanblock + scanoffset[plane]; // Row to load data for
+    if(row >= nRows) row -= nRows;
+    duration += BLANKTIME;
+    ISRTICKS(SCANTIME);
+  } else if(++plane >= nPlanes) { // Advance plane counter.  Maxed out?
     plane = 0;                  // Yes, reset to plane 0, and
     if(++row >= nRows) {        // advance row counter.  Maxed out?
-      row     = 0;              // Yes, reset row counter, then...
-      if(swapflag == true) {    // Swap front/back buffers if requested
-        backindex = 1 - backindex;
-        swapflag  = false;
-      }
-      buffptr = matrixbuff[1-backindex]; // Reset into front buffer
+      row      = 0;             // Yes, reset row counter, then...
+      newframe = true;
     }
   } else if(plane == 1) {
     // Plane 0 was loaded on prior interrupt invocation and is about to
     // latch now, so update the row address lines before we do that:
-    if(row & 0x1)   A_PORT |=  (1 << A_PIN);
-    else            A_PORT &= ~(1 << A_PIN);
-    if(row & 0x2)   B_PORT |=  (1 << B_PIN);
-    else            B_PORT &= ~(1 << B_PIN);
-    if(row & 0x4)   C_PORT |=  (1 << C_PIN);
-    else            C_PORT &= ~(1 << C_PIN);
+    addr = row;
+  }
+  if(newframe) {
+    framecount++;
+    ISRTICKS(8); // Estimated, not measured
+    if(rowpending) {            // Row source set while interleaving:
+      rowsource      = rowpending; // plane 0 of row 0 is next either
+      rowpending     = NULL;    // way, so the scans meet here
+      scaninterleave = false;
+    }
+    if(swapflag == true) {      // Show the ready frame if there's one
+      i          = frontindex;
+      frontindex = readyindex;
+      readyindex = i;           // With 2 buffers, swapPending() takes it
+      swapflag   = false;       // as the new back buffer
+      swapcount++;
+      if(swapcallback) swapcallback();
+    }
+    buffptr = matrixbuff[frontindex]; // Reset into front buffer
+  }
+  if(addr != 0xFF) {
+    if(addr & 0x1)   A_PORT |=  (1 << A_PIN);
+    else             A_PORT &= ~(1 << A_PIN);
+    if(addr & 0x2)   B_PORT |=  (1 << B_PIN);
+    else             B_PORT &= ~(1 << B_PIN);
+    if(addr & 0x4)   C_PORT |=  (1 << C_PIN);
+    else             C_PORT &= ~(1 << C_PIN);
     if(nRows > 8) {
-      if(row & 0x8) D_PORT |=  (1 << D_PIN);
-      else          D_PORT &= ~(1 << D_PIN);
+      if(addr & 0x8) D_PORT |=  (1 << D_PIN);
+      else           D_PORT &= ~(1 << D_PIN);
     }
   }
 
-  // buffptr, being 'volatile' type, doesn't take well to optimization.
-  // A local register copy can speed some things up:
-  ptr = (uint8_t *)buffptr;
+  if(scaninterleave) {
+    // Rows aren't read in order, so find this one's plane byte.  With
+    // plane 0 packed, plane n is in byte n-1 and plane 0 at the row start.
+    ptr = matrixbuff[frontindex] + row * (WIDTH * PLANEBYTES);
+    if(plane) ptr += (plane - (nPlanes - PLANEBYTES)) * WIDTH;
+  } else {
+    // buffptr, being 'volatile' type, doesn't take well to optimization.
+    // A local register copy can speed some things up:
+    ptr = (uint8_t *)buffptr;
+  }
 
   ICR1      = duration; // Set interval for next interrupt
   TCNT1     = 0;        // Restart interrupt timer
+  if(scaninterleave) __builtin_avr_delay_cycles(BLANKTIME);
   OE_PORT  &= ~(1 << OE_PIN);  // Re-enable output
   LAT_PORT &= ~(1 << LAT_PIN); // Latch down
 
@@ -1907,14 +3426,34 @@ void RGBmatrixPanel_updateDisplay(void) {
   tock = CLKPORT;
   tick = tock | (1 << CLK_PIN);
 
-  if(plane > 0) { // 188 ticks from TCNT1=0 (above) to end of function
+  // Decode-ahead, for frames kept in some compact format (palette
+  // indices, or whatever a setRowSource() function reads): a row's
+  // plane 0 loads while the previous row's last (longest) plane shows,
+  // so there's time then to expand the whole row into rowcache, a port
+  // byte per plane and column.  All its planes then clock out from
+  // there like any unpacked plane, however the frame is stored: rowcache
+  // runs plane after plane, so buffptr follows it to the next one as it
+  // would through matrixbuff, and the short planes cost nothing extra.
+  if((plane == 0) && rowsource) {
+    rowsource(row, rowcache);
+    ptr = rowcache;
+    ISRTICKS(5); // Estimated, not measured: the call
+  }
+
+  if((PLANEBYTES == nPlanes) || (plane > 0) || rowsource) { // 188 ticks from TCNT1=0 to end
 
-    // Planes 1-3 copy bytes directly from RAM to PORT without unpacking.
-    // The least 2 bits (used for plane 0 data) are presumed masked out
-    // by the port direction bits.
+    // Planes 1-3 (all planes, if plane 0 isn't packed) copy bytes
+    // directly from RAM to PORT without unpacking.  The least 2 bits
+    // (used for plane 0 data) are presumed masked out by the port
+    // direction bits.
     // A tiny bit of inline assembly is used; compiler doesn't pick
     // up on opportunity for post-increment addressing mode.
     // 5 instruction ticks per 'pew' = 160 ticks total
+#ifdef RGBMATRIX_HOST
+    // No AVR asm on the host build; same load/out/clock sequence in C.
+    #define pew { DATAPORT = *ptr++; CLKPORT = tick; CLKPORT = tock; \
+                  ISRTICKS(5); }
+#else
     #define pew asm volatile(                 \
       "ld  __tmp_reg__, %a[ptr]+"    "\n\t"   \
       "out %[data]    , __tmp_reg__" "\n\t"   \
@@ -1925,6 +3464,7 @@ void RGBmatrixPanel_updateDisplay(void) {
          [clk]  "I" (_SFR_IO_ADDR(CLKPORT)),  \
          [tick] "r" (tick),                   \
          [tock] "r" (tock));
+#endif
     // Loop is unrolled for speed:
     pew pew pew pew pew pew pew pew
     pew pew pew pew pew pew pew pew
@@ -1939,6 +3479,8 @@ void RGBmatrixPanel_updateDisplay(void) {
     }
 
     buffptr = ptr; //+= 32;
+    ISRTICKS(188 - 32 * 5); // Measured total less the 32 pew's
+
 
   } else { // 920 ticks from TCNT1=0 (above) to end of function
     // Planes 1-3 (handled above) formatted their data "in place,"
@@ -1957,7 +3499,332 @@ void RGBmatrixPanel_updateDisplay(void) {
         ((ptr[i+WIDTH*2] << 2) & 0x0C);
       CLKPORT = tick; // Clock lo
       CLKPORT = tock; // Clock hi
+      ISRTICKS(28);
     } 
+    ISRTICKS(920 - 32 * 28); // Measured total less 32 loop passes
   }
+
+#if ISRSTATS
+  // TCNT1 has counted from the restart above, so this is how much of
+  // the interval just started the handler took.  If the timer passed
+  // ICR1 meanwhile, it wrapped, and the next interrupt is already due.
+  // Only noted here; the shortest intervals have no time to spare, so
+  // the totals are brought up to date once a row, in the plane 0 call
+  // (with the longest interval).
+  t = TCNT1;
+  if(TIFR & _BV(TOV1)) {
+    t += duration + 1;
+    isroverruns++;
+  }
+  isrtime[plane]  = t;
+  isrentry[plane] = entry;
+  ISRTICKS(20); // Estimated, not measured
+  if(plane == 0) {
+    for(i=0; i<nPlanes; i++) {
+      if(isrtime[i]  > isrworst)   isrworst   = isrtime[i];
+      if(isrentry[i] > isrlatency) isrlatency = isrentry[i];
+      isrbusy += isrtime[i];
+    }
+    ISRTICKS(nPlanes * 40); // Estimated, not measured
+  }
+#endif
 }
 
+// -------------------- Animation player --------------------
+
+// CPU ticks per display refresh, from the interrupt timing as worked
+// out above (an overrunning handler takes longer; isrcost shows when).
+static uint32_t RGBmatrixPanel_frameTicks(void) {
+  uint16_t t = ((nRows > 8) || (nPlanes > 7)) ?
+    (LOOPTIME + STATSTIME) : ((LOOPTIME + STATSTIME) * 2);
+  uint32_t rowticks = 0;
+  uint8_t  p;
+
+  if(scaninterleave) t += SCANTIME;
+  for(p=0; p<nPlanes; p++) {
+    rowticks += (uint32_t)(t + CALLOVERHEAD * 2) << p;
+    if(scaninterleave) rowticks += BLANKTIME;
+  }
+  return rowticks * nRows;
+}
+
+// Display refreshes per second, estimated likewise.
+uint16_t RGBmatrixPanel_refreshRate(void) {
+  return F_CPU / RGBmatrixPanel_frameTicks();
+}
+
+// Display refreshes started since begin(), wrapping at 65536; the
+// interrupt counts one each time it goes back to the top of the frame
+// (where swaps happen).
+uint16_t RGBmatrixPanel_frameCount(void) {
+  uint8_t  on = TIMSK & _BV(TOIE1);
+  uint16_t n;
+
+  TIMSK &= ~_BV(TOIE1); // Counter is 2 bytes; don't let the ISR see half
+  n      = framecount;
+  TIMSK |= on;
+  return n;
+}
+
+// Get ready to play pl's frames from the first, at fps frames per
+// second -- rounded to a whole number of display refreshes per frame,
+// so every frame is shown for the same time.  Set pl->image (opened),
+// or pl->packed or pl->draw and pl->frames, first; the rest of *pl is
+// set up here.  The first frame is due one frame time from now.
+void RGBmatrixPanel_playerInit(RGBmatrixPanel_Player *pl, uint8_t fps) {
+  uint16_t n = (RGBmatrixPanel_refreshRate() + fps / 2) / fps;
+
+  pl->period  = n ? ((n > 255) ? 255 : n) : 1;
+  pl->copy    = !pl->packed; // Packed bitmaps cover the whole screen
+  pl->ready   = false;
+  pl->frame   = 0;
+  pl->due     = RGBmatrixPanel_frameCount() + pl->period;
+  pl->shown   = 0;
+  pl->late    = 0;
+  pl->dropped = 0;
+}
+
+// Call from loop() as often as there's time for; it never waits.  The
+// next frame is drawn into the back buffer as soon as that's free, and
+// its swap asked for during the refresh before it's due, so it shows
+// from the start of that refresh.  One that misses it goes up at the
+// next refresh instead, counted in pl->late; when loop() has fallen a
+// whole frame time or more behind, frames are skipped (pl->dropped,
+// compressed ones still decoded, as the next builds on them) to keep
+// time.  Returns true when a frame was put up.  Needs double or triple
+// buffering; single-buffered, frames are drawn as they fall due and
+// may tear.
+bool RGBmatrixPanel_playerUpdate(RGBmatrixPanel_Player *pl) {
+  uint16_t frames = pl->image ? pl->image->frames : pl->frames;
+  bool     single = (matrixbuff[0] == matrixbuff[1]);
+  int16_t  ahead; // Refreshes to go before the swap should be asked for
+
+  if(!frames || RGBmatrixPanel_swapPending()) return false;
+  ahead = pl->due - (RGBmatrixPanel_frameCount() + 1);
+  if(!pl->ready) {
+    if(single && (ahead > 0)) return false; // Drawing shows at once
+    while(-ahead >= (int16_t)pl->period) {  // A frame or more behind
+      if(pl->image) RGBmatrixPanel_imageNext(pl->image);
+      if(++pl->frame >= frames) pl->frame = 0;
+      pl->due += pl->period;
+      ahead   += pl->period;
+      pl->dropped++;
+    }
+    if(pl->image) {
+      RGBmatrixPanel_imageNext(pl->image);
+    } else if(pl->packed) {
+      RGBmatrixPanel_drawPacked(
+        (const uint8_t *)pgm_read_pointer(&pl->packed[pl->frame]), 0);
+    } else if(pl->draw) {
+      pl->draw(pl->frame);
+    }
+    pl->ready = true;
+    ahead     = pl->due - (RGBmatrixPanel_frameCount() + 1); // Time passed
+  }
+  if(ahead > 0) return false;
+  if(!single) RGBmatrixPanel_requestSwap(pl->copy);
+  if(ahead < 0) pl->late++;
+  pl->shown++;
+  pl->ready = false;
+  if(++pl->frame >= frames) pl->frame = 0;
+  pl->due += pl->period;
+  return true;
+}
+
+// -------------------- Refresh statistics --------------------
+
+static uint16_t statsframe; // framecount at the previous snapshot
+
+// Take a snapshot of refresh health into *s, starting a new timing
+// period: e.g. once a second from loop(), to log or to check that
+// drawing isn't holding the display off (latency, overruns) or leaving
+// loop() too little time (load).  Take one at least every minute or
+// so, before the counts behind the averages wrap.
+void RGBmatrixPanel_stats(RGBmatrixPanel_Stats *s) {
+  uint8_t  on = TIMSK & _BV(TOIE1);
+  uint32_t busy = 0, calls, span;
+
+  TIMSK &= ~_BV(TOIE1); // All from one instant
+  s->frames = framecount;
+  s->swaps  = swapcount;
+#if ISRSTATS
+  s->worst    = isrworst;
+  s->latency  = isrlatency;
+  s->overruns = isroverruns;
+  busy        = isrbusy;
+  isrworst    = isrlatency = isroverruns = 0;
+  isrbusy     = 0;
+#else
+  s->worst    = s->latency = s->overruns = 0;
+#endif
+  TIMSK |= on;
+
+  s->refreshes = s->frames - statsframe;
+  statsframe   = s->frames;
+  calls        = (uint32_t)s->refreshes * nRows * nPlanes;
+  span         = s->refreshes * RGBmatrixPanel_frameTicks() / 100;
+  s->average   = (busy && calls) ? busy / calls : 0;
+  // Interrupt entry and exit (CALLOVERHEAD each) aren't in busy
+  s->load      = (busy && span) ?
+    (busy + calls * CALLOVERHEAD * 2 + span / 2) / span : 0;
+}
+
+// -------------------- Serial frame streaming --------------------
+
+// A PC can stream frames in over the UART (extras/matrixsend.cpp), sent
+// already in the frame buffer's layout, so each byte goes straight into
+// the back buffer as it arrives -- no per-pixel work here at all.  Each
+// packet is
+//
+//   SERIALSYNC, flags, line, lines, col, cols, header check,
+//   lines * cols data bytes, 2 data check bytes
+//
+// and fills a rectangle of the buffer, seen as nRows * PACKLINES lines
+// of WIDTH / PACKCOLS bytes (as a packed bitmap is): 'lines' lines from
+// 'line', 'cols' bytes of each from 'col'.  A full frame is then line 0
+// and column 0, all lines and columns; a changed area only needs the
+// lines and columns it covers.  The header check is the 8-bit sum of
+// the 5 bytes before it, the data check a Fletcher sum of the data
+// (sum of bytes, then sum of those sums).  Flags: SERIALSWAP to swap
+// once the data is in, SERIALCOPY to make that a swapBuffers(true), as
+// an update only covering changes needs; SERIALQUERY for no data, just
+// a reply of SERIALACK, WIDTH, HEIGHT and IMAGELAYOUT, so the sender
+// can check it matches.  Every packet is answered with one byte, once
+// it's in and any swap done: SERIALACK, or SERIALNAK if its header or
+// data didn't check out (the data may have been written anyway, so
+// sending it again puts that right).  A packet whose header is refused
+// has the rest of it thrown away unread, until the line has gone quiet
+// for a whole refresh, and only then is answered: SERIALSYNC bytes in
+// its data can't start a false packet, nor eat the sender's retry.  The
+// sender waits for the answer before sending more; that's all the flow
+// control there is, and the back buffer is never written while a swap
+// is pending.
+
+#define SERIALDATA  SERIALHEADER       ///< serialstate: taking data
+#define SERIALCHECK (SERIALHEADER + 1) ///< ...data check, 2 bytes
+#define SERIALWAIT  (SERIALHEADER + 3) ///< ...waiting for the swap
+#define SERIALSKIP  (SERIALHEADER + 4) ///< ...refused, until the line's quiet
+
+static uint8_t  serialhead[SERIALHEADER]; // Packet header
+static uint8_t  serialstate;   // Header bytes had, or SERIALDATA on
+static uint8_t *serialdst;     // Back buffer byte the next one goes to
+static uint8_t  serialcol,     // Bytes to go on the current line
+                seriallines,   // Lines to go, the current one included
+                serialsum1,    // Data check so far
+                serialsum2;
+static bool     serialbad;     // UART framing error or overrun seen
+static uint16_t serialheard,   // framecount when bytes last came in
+                serialtimeout; // Refreshes before a stalled packet's lost
+
+// Set up the UART for RGBmatrixPanel_serialPoll(): 8 data bits, no
+// parity, 1 stop bit (the chip's default) at the given baud rate, with
+// double-speed mode for the closest divisor.  Call after begin().
+void RGBmatrixPanel_serialBegin(uint32_t baud) {
+  uint16_t ubrr = (F_CPU + baud * 4) / (baud * 8) - 1;
+
+  UBRRH         = ubrr >> 8;
+  UBRRL         = ubrr;
+  UCSRA         = _BV(U2X);
+  UCSRB         = _BV(RXEN) | _BV(TXEN);
+  serialstate   = 0;
+  serialtimeout = RGBmatrixPanel_refreshRate() / 4 + 1; // 1/4 second
+}
+
+static void RGBmatrixPanel_serialSend(uint8_t c) {
+  while(!(UCSRA & _BV(UDRE)));
+  UDR = c;
+}
+
+// Packet's data is all in (or it had none): answer it, or start its swap
+static void RGBmatrixPanel_serialEnd(bool ok) {
+  serialstate = 0;
+  if(!ok) {
+    RGBmatrixPanel_serialSend(SERIALNAK);
+  } else if(serialhead[1] & SERIALSWAP) {
+    RGBmatrixPanel_requestSwap(serialhead[1] & SERIALCOPY);
+    serialstate = SERIALWAIT; // serialPoll() answers once it's done
+  } else {
+    RGBmatrixPanel_serialSend(SERIALACK);
+  }
+}
+
+// Whole header in: check it, and get ready to take its data
+static void RGBmatrixPanel_serialHeader(void) {
+  uint8_t *h = serialhead;
+
+  if(serialbad || ((uint8_t)(h[1] + h[2] + h[3] + h[4] + h[5]) != h[6]) ||
+     (h[2] + h[3] > nRows * PACKLINES) || (h[4] + h[5] > WIDTH / PACKCOLS)) {
+    serialstate = SERIALSKIP; // serialPoll() answers once the line's quiet
+    return;
+  }
+  if(h[1] & SERIALQUERY) {
+    serialstate = 0;
+    RGBmatrixPanel_serialSend(SERIALACK);
+    RGBmatrixPanel_serialSend(WIDTH);
+    RGBmatrixPanel_serialSend(HEIGHT);
+    RGBmatrixPanel_serialSend(IMAGELAYOUT);
+    return;
+  }
+  if(!h[3] || !h[5]) { // No data, e.g. just a swap
+    RGBmatrixPanel_serialEnd(true);
+    return;
+  }
+  memset(&rowdirty[h[2] / PACKLINES], 1,
+    (h[2] + h[3] - 1) / PACKLINES - h[2] / PACKLINES + 1);
+  serialdst   = matrixbuff[backindex] + h[2] * (WIDTH / PACKCOLS) + h[4];
+  serialcol   = h[5];
+  seriallines = h[3];
+  serialsum1  = serialsum2 = 0;
+  serialstate = SERIALDATA;
+}
+
+// Call from loop() as often as there's time for while frames stream
+// in; it takes whatever bytes the UART has and never waits.  The UART
+// only holds 2 bytes besides the one coming in, so at 115200 baud,
+// about 87 us a byte, that should be every couple of hundred us at
+// most, less the time refresh interrupts take (see RGBmatrixPanel_stats()).
+// Returns true when a packet's swap has just happened.  Works single
+// buffered too, the data then showing as it comes in.
+bool RGBmatrixPanel_serialPoll(void) {
+  uint8_t c;
+
+  if(serialstate != SERIALWAIT) {
+    if(UCSRA & _BV(RXC)) {
+      serialheard = RGBmatrixPanel_frameCount();
+      do {
+        if(UCSRA & (_BV(FE) | _BV(DOR))) serialbad = true; // Before UDR
+        c = UDR;
+        if(serialstate == SERIALDATA) { // Most bytes: keep this short
+          *serialdst++ = c;
+          serialsum2  += (serialsum1 += c);
+          if(!--serialcol) {
+            serialcol  = serialhead[5];
+            serialdst += WIDTH / PACKCOLS - serialcol;
+            if(!--seriallines) serialstate = SERIALCHECK;
+          }
+        } else if(serialstate == SERIALCHECK) {
+          if(c != serialsum1) serialbad = true;
+          serialstate++;
+        } else if(serialstate == SERIALSKIP) {
+          // Rest of a refused packet: dropped
+        } else if(serialstate > SERIALCHECK) {
+          RGBmatrixPanel_serialEnd(!serialbad && (c == serialsum2));
+        } else if(serialstate || (c == SERIALSYNC)) {
+          if(!serialstate) serialbad = false;
+          serialhead[serialstate++] = c;
+          if(serialstate == SERIALHEADER) RGBmatrixPanel_serialHeader();
+        }
+      } while((serialstate != SERIALWAIT) && (UCSRA & _BV(RXC)));
+    } else if(serialstate && ((uint16_t)(RGBmatrixPanel_frameCount() -
+      serialheard) > ((serialstate == SERIALSKIP) ? 1 : serialtimeout))) {
+      // Refused packet's over, or sender went quiet part way; start over
+      if(serialstate == SERIALSKIP) RGBmatrixPanel_serialSend(SERIALNAK);
+      serialstate = 0;
+    }
+  }
+  if((serialstate != SERIALWAIT) || RGBmatrixPanel_swapPending())
+    return false;
+  serialstate = 0;
+  RGBmatrixPanel_serialSend(SERIALACK);
+  return true;
+}
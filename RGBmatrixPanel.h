@@ -1,16 +1,24 @@
 #ifndef RGBMATRIXPANEL_H
 #define RGBMATRIXPANEL_H
+#ifndef F_CPU
 #define F_CPU 8000000UL
+#endif
+#ifndef RGBMATRIX_HOST
 #include <util/delay.h>
+#endif
 #include <stdint.h>
+#ifndef RGBMATRIX_HOST
 #include <avr/interrupt.h>
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include <inttypes.h>
+#ifndef RGBMATRIX_HOST
 #include <avr/io.h>
 #include <avr/pgmspace.h>
+#endif
 
 #include "config.h"
 #include "glcdfont.c"
@@ -25,13 +33,38 @@
 #define delay _delay_ms
 void _delay_ms(double ms);
 
-uint8_t         *matrixbuff[2];
+uint8_t         *matrixbuff[3];
+#ifdef MATRIX_WIDTH
+// Geometry fixed at build time (see config.h).  As constants, address
+// math folds down and code for other panel sizes drops out of flash.
+#define WIDTH  ((int16_t)MATRIX_WIDTH)          ///< 'raw' display width
+#define HEIGHT ((int16_t)MATRIX_HEIGHT)         ///< 'raw' display height
+#define nRows  ((uint8_t)(MATRIX_HEIGHT / 2))   ///< Multiplexed rows
+#else
 uint8_t          nRows;
-volatile uint8_t backindex;
-volatile bool swapflag;
 int16_t
     WIDTH,          ///< This is the 'raw' display width - never changes
-    HEIGHT,         ///< This is the 'raw' display height - never changes
+    HEIGHT;         ///< This is the 'raw' display height - never changes
+#endif
+volatile uint8_t backindex;  ///< Buffer being drawn into
+volatile uint8_t frontindex; ///< Buffer being shown by the interrupt
+volatile uint8_t readyindex; ///< Finished frame to show next (= back if 2)
+bool          triplebuf;     ///< Third buffer: swaps never wait
+volatile bool swapflag;
+bool          swapcopy;            ///< Copy due once swapflag clears
+void        (*swapcallback)(void); ///< Called by the ISR after a swap
+volatile uint16_t framecount;      ///< Display refreshes done; wraps
+volatile uint16_t swapcount;       ///< Swaps the ISR has done; wraps
+#if ISRSTATS
+// Interrupt timing since the last RGBmatrixPanel_stats(), in ticks
+uint16_t isrworst;    ///< Longest call, from timer restart to return
+uint16_t isrlatency;  ///< Longest from timer overflow to the handler
+uint16_t isroverruns; ///< Calls that outlasted their own interval
+uint32_t isrbusy;     ///< All calls, from timer restart to return
+uint16_t isrtime[nPlanes];  ///< Last call per plane, timer restart to return
+uint16_t isrentry[nPlanes]; ///< Last call per plane, overflow to handler
+#endif
+int16_t
     _width,         ///< Display width as modified by current rotation
     _height,        ///< Display height as modified by current rotation
     cursor_x,       ///< x location to start print()ing text
@@ -48,7 +81,195 @@ bool
 GFXfont *gfxFont;       ///< Pointer to special font
     
 volatile uint8_t row, plane;
+bool    scaninterleave; ///< Interleaved scan, set by begin()
+uint8_t scanblock;      ///< Interleaved scan position in the frame
+uint8_t scanoffset[8];  ///< Interleaved scan: row offset per plane
 volatile uint8_t *buffptr;
+uint8_t  rowdirty[16]; ///< Per row pair: back & front buffers may differ
+uint16_t swapsaved;    ///< Bytes the last swapBuffers(true) didn't copy
+uint16_t *canvas16;    ///< If set, drawing goes to this 5-6-5 canvas
+
+#if (nPlanes < 2) || (nPlanes > 8)
+ #error "nPlanes must be 2 to 8"
+#endif
+// Frame buffer bytes per column per row pair, one per bit plane -- but
+// with 4 or more planes, plane 0 is packed into the spare low bits of
+// planes 1-3 and needs no byte of its own.  ROWBYTES is a whole row
+// pair.  In palette mode the buffer holds indices instead, and rows
+// are expanded to one byte per plane (unpacked) as they are scanned.
+#if defined(PALETTEBITS)
+ #if (PALETTEBITS != 1) && (PALETTEBITS != 2)
+  #error "PALETTEBITS must be 1 or 2"
+ #endif
+ // Expanding a row costs about WIDTH * (10 + 4 * nPlanes) ticks, all in
+ // the longest plane's interval, which with too few planes is shorter
+ #if defined(MATRIX_WIDTH) && \
+     (((MATRIX_WIDTH > 32) && (nPlanes < 4)) || \
+      ((MATRIX_HEIGHT > 16) && (nPlanes < 3)))
+  #error "PALETTEBITS needs nPlanes >= 3 at 32x32, >= 4 at 64 wide"
+ #endif
+ #define PLANEBYTES nPlanes
+ #define ROWBYTES   (WIDTH * PALETTEBITS / 4)
+#elif nPlanes >= 4
+ #define PLANEBYTES (nPlanes - 1)
+ #define ROWBYTES   (WIDTH * PLANEBYTES)
+#else
+ #define PLANEBYTES nPlanes
+ #define ROWBYTES   (WIDTH * PLANEBYTES)
+#endif
+
+#ifdef PALETTEBITS
+uint16_t palette[1 << PALETTEBITS]; ///< 5-6-5 color of each index
+/// Port byte bits, per plane, for each index pair of a column (upper
+/// half index in the low PALETTEBITS bits, lower half above it)
+uint8_t  paletteport[1 << (2 * PALETTEBITS)][nPlanes];
+#endif
+/// Expands a row of some compact frame format for the interrupt to
+/// scan (see RGBmatrixPanel_setRowSource()); NULL scans matrixbuff.
+void   (*rowsource)(uint8_t r, uint8_t *dst);
+/// Source set while the interleaved scan was on, taking over at the top
+/// of the next frame
+void   (*rowpending)(uint8_t r, uint8_t *dst);
+uint8_t *rowcache; ///< Row being scanned, expanded: nPlanes * WIDTH
+
+/// A 16-bit color worked out into the packed frame buffer layout: for
+/// the upper (0) and lower (1) display halves, the bits of each of a
+/// column's PLANEBYTES bytes to keep, and the bits to then set.  See
+/// RGBmatrixPanel_makePattern().
+typedef struct {
+  uint8_t keep[2][PLANEBYTES]; ///< AND masks, per half and plane byte
+  uint8_t set[2][PLANEBYTES];  ///< OR bits, per half and plane byte
+  uint16_t color;              ///< The 5-6-5 color, for drawing to a canvas
+#ifdef PALETTEBITS
+  uint8_t  index;              ///< Nearest palette entry, in palette mode
+#endif
+} RGBmatrixPanel_Pattern;
+
+/// One glyph of a laid-out string: what RGBmatrixPanel_drawChar() would
+/// otherwise look up in PROGMEM again on every redraw.
+typedef struct {
+  const uint8_t *bitmap; ///< Glyph bits in PROGMEM (font[] columns if classic)
+  int16_t        x, y;   ///< Bitmap top left, relative to the layout origin
+  uint8_t        w, h;   ///< Bitmap size in font pixels
+} RGBmatrixPanel_LaidGlyph;
+
+/// A string measured and placed once by RGBmatrixPanel_layoutText(),
+/// then drawn by RGBmatrixPanel_drawLayout() at any origin.
+typedef struct {
+  RGBmatrixPanel_LaidGlyph *glyph; ///< Caller's array, one per inked glyph
+  uint8_t  count;          ///< Glyphs placed
+  uint8_t  size_x, size_y; ///< Text size it was laid out at
+  bool     classic;        ///< Built-in font, column bitmaps
+  int16_t  x1, y1;         ///< Bounds, relative to the origin
+  uint16_t w, h;
+  int16_t  advance;        ///< Cursor x travel, origin to end of string
+} RGBmatrixPanel_TextLayout;
+
+/// A rectangle in display (rotated) coordinates.
+typedef struct {
+  int16_t x, y, w, h;
+} RGBmatrixPanel_Rect;
+
+/// One sprite of a RGBmatrixPanel_Layers stack.  The application moves
+/// it, hides it or changes its bitmap or size by setting the fields; the
+/// compositor notices and redraws the areas concerned.
+typedef struct {
+  const uint16_t *bitmap; ///< w*h 5-6-5 pixels in PROGMEM, row by row
+  const uint8_t  *mask;   ///< 1 bit per pixel, rows byte-padded, PROGMEM; or NULL
+  uint16_t        key;    ///< Transparent color, with no mask
+  bool            keyed;  ///< Use key (no mask and no key: opaque)
+  bool            visible;
+  int16_t         x, y;
+  uint8_t         w, h;
+  // Where it was last composited, for the compositor's use:
+  const uint16_t *shownbitmap;
+  int16_t         shownx, showny;
+  uint8_t         shownw, shownh;
+  bool            shown;
+} RGBmatrixPanel_Sprite;
+
+#ifndef LAYERDIRTY
+#define LAYERDIRTY 8 ///< Dirty rectangles kept; more merge together
+#endif
+
+/// A static background (color or full-display PROGMEM 5-6-5 bitmap),
+/// sprites on top of it, bottom first, and a text overlay above all,
+/// composited into the back buffer only where something changed.
+typedef struct {
+  uint16_t                         bgcolor;
+  const uint16_t                  *bgbitmap; ///< _width*_height, or NULL
+  RGBmatrixPanel_Sprite           *sprite;   ///< Caller's array
+  uint8_t                          nsprites;
+  const RGBmatrixPanel_TextLayout *text;     ///< Overlay, or NULL
+  int16_t                          textx, texty;
+  uint16_t                         textcolor;
+  RGBmatrixPanel_Rect              dirty[LAYERDIRTY];
+  uint8_t                          ndirty;
+} RGBmatrixPanel_Layers;
+
+/// Display refresh health, from RGBmatrixPanel_stats().  Counts are
+/// running totals (wrapping); timings cover the time since the
+/// previous snapshot, in CPU ticks, and are 0 if built with ISRSTATS 0.
+typedef struct {
+  uint16_t frames;    ///< Refreshes started
+  uint16_t swaps;     ///< Buffer swaps done by the interrupt
+  uint16_t refreshes; ///< Refreshes since the previous snapshot
+  uint16_t worst;     ///< Longest interrupt, timer restart to return
+  uint16_t average;   ///< Mean interrupt, likewise
+  uint16_t latency;   ///< Longest wait from timer overflow to interrupt
+                      ///< (long when other code holds interrupts off)
+  uint16_t overruns;  ///< Interrupts that ran past their own interval
+  uint8_t  load;      ///< Percent of CPU time taken by the interrupt
+} RGBmatrixPanel_Stats;
+
+/// Frame buffer layout byte of a compressed image's header: nPlanes, or
+/// in palette mode 0x80 plus PALETTEBITS.  An image only plays on a
+/// build with the layout it was converted for.
+#ifdef PALETTEBITS
+#define IMAGELAYOUT (0x80 | PALETTEBITS)
+#else
+#define IMAGELAYOUT nPlanes
+#endif
+#define IMAGEHEADER 5 ///< Width, height, IMAGELAYOUT, frame count (LE)
+#define PACKEDHEADER 3 ///< Width, height, IMAGELAYOUT
+
+/// Serial frame streaming (RGBmatrixPanel_serialPoll()): packet start,
+/// header flags and the one-byte replies.
+#define SERIALSYNC   0xA5
+#define SERIALHEADER 7    ///< Sync, flags, line, lines, col, cols, check
+#define SERIALSWAP   0x01 ///< Swap once the data is in
+#define SERIALCOPY   0x02 ///< ...as swapBuffers(true)
+#define SERIALQUERY  0x04 ///< No data; reply WIDTH, HEIGHT, IMAGELAYOUT
+#define SERIALACK    0x06
+#define SERIALNAK    0x15
+
+/// A compressed PROGMEM image or animation (extras/imageconvert.cpp)
+/// being played into the back buffer by RGBmatrixPanel_imageNext().
+typedef struct {
+  const uint8_t *data;   ///< The image, header first
+  const uint8_t *next;   ///< Codes of the next frame to decode
+  uint16_t       frames; ///< Frames in the image
+  uint16_t       frame;  ///< Number of the next frame to decode
+} RGBmatrixPanel_Image;
+
+/// Plays a sequence of frames into the back buffer, swapping in step
+/// with the display refresh (RGBmatrixPanel_playerUpdate()).  Frames
+/// come from whichever of image, packed or draw is set.
+typedef struct {
+  RGBmatrixPanel_Image   *image;   ///< Opened compressed frames
+  const uint8_t * const *packed;  ///< PROGMEM table of packed bitmaps
+  void                 (*draw)(uint16_t frame); ///< Draws frame n
+  uint16_t               frames;  ///< Frames in packed[] or for draw()
+  bool                   copy;    ///< Swap with copy (frames build on
+                                  ///< the last); false for packed
+  uint8_t                period;  ///< Display refreshes per frame
+  bool                   ready;   ///< Next frame is in the back buffer
+  uint16_t               frame;   ///< Number of the next frame
+  uint16_t               due;     ///< framecount it should show from
+  uint16_t               shown;   ///< Frames swapped in
+  uint16_t               late;    ///< ...of those, after they were due
+  uint16_t               dropped; ///< Frames skipped to keep time
+} RGBmatrixPanel_Player;
 
 void RGBmatrixPanel_printNumber(unsigned long, uint8_t);
 size_t RGBmatrixPanel_write(uint8_t c);
@@ -152,6 +373,11 @@ RGBmatrixPanel_drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color,
       uint16_t bg, uint8_t size_x, uint8_t size_y),
 RGBmatrixPanel_getTextBounds(const char *string, int16_t x, int16_t y,
   int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h),
+RGBmatrixPanel_drawTextOpaque(const char *str, int16_t x, int16_t y,
+  uint16_t fg, uint16_t bg, int16_t bx, int16_t by, uint16_t bw, uint16_t bh),
+RGBmatrixPanel_drawTextOpaque(const char *str, uint16_t fg, uint16_t bg),
+RGBmatrixPanel_drawLayout(const RGBmatrixPanel_TextLayout *l, int16_t x,
+  int16_t y, uint16_t color, int16_t wx = 0, int16_t ww = 0x7FFF),
 RGBmatrixPanel_setTextSize(uint8_t s),
 RGBmatrixPanel_setTextSize(uint8_t sx, uint8_t sy),
 RGBmatrixPanel_setFont(const GFXfont *f = NULL);
@@ -254,29 +480,81 @@ int16_t RGBmatrixPanel_getCursorY(void) { return cursor_y; };
 
 void RGBmatrixPanel_charBounds(char c, int16_t *x, int16_t *y,
   int16_t *minx, int16_t *miny, int16_t *maxx, int16_t *maxy);
+void RGBmatrixPanel_drawGlyph(int16_t left, int16_t top,
+  const uint8_t *bitmap, uint8_t w, uint8_t h, uint16_t color,
+  uint8_t size_x, uint8_t size_y, int16_t cx0, int16_t cx1);
+int16_t RGBmatrixPanel_textWidth(const char *str);
+void RGBmatrixPanel_layersInit(RGBmatrixPanel_Layers *l,
+  RGBmatrixPanel_Sprite *sprites, uint8_t n, uint16_t bgcolor,
+  const uint16_t *bgbitmap),
+RGBmatrixPanel_layersDirty(RGBmatrixPanel_Layers *l, int16_t x, int16_t y,
+  int16_t w, int16_t h),
+RGBmatrixPanel_layersText(RGBmatrixPanel_Layers *l,
+  const RGBmatrixPanel_TextLayout *t, int16_t x, int16_t y, uint16_t color),
+RGBmatrixPanel_layersCompose(RGBmatrixPanel_Layers *l);
+bool RGBmatrixPanel_imageOpen(RGBmatrixPanel_Image *im, const uint8_t *data);
+uint16_t RGBmatrixPanel_imageNext(RGBmatrixPanel_Image *im);
+bool RGBmatrixPanel_drawPacked(const uint8_t *bmp, int16_t x);
+void RGBmatrixPanel_playerInit(RGBmatrixPanel_Player *pl, uint8_t fps);
+bool RGBmatrixPanel_playerUpdate(RGBmatrixPanel_Player *pl);
+uint16_t RGBmatrixPanel_frameCount(void),
+RGBmatrixPanel_refreshRate(void);
+void RGBmatrixPanel_stats(RGBmatrixPanel_Stats *s);
+void RGBmatrixPanel_serialBegin(uint32_t baud);
+bool RGBmatrixPanel_serialPoll(void);
+uint8_t RGBmatrixPanel_layoutText(RGBmatrixPanel_TextLayout *l,
+  RGBmatrixPanel_LaidGlyph *glyphs, uint8_t max, const char *str,
+  int16_t x, int16_t y);
 
 // Constructor for 16x32 panel:
 void RGBmatrixPanel_RGBmatrixPanel(bool dbuf);
 
 // Constructor for 32x32 panel (adds 'd' pin):
-void RGBmatrixPanel_RGBmatrixPanel(bool dbuf, uint8_t width=32);
+void RGBmatrixPanel_RGBmatrixPanel(bool dbuf, uint8_t width=32,
+  bool tbuf=false);
 
 void
 RGBmatrixPanel_begin(void),
+RGBmatrixPanel_begin(bool interleave),
 RGBmatrixPanel_drawPixel(int16_t x, int16_t y, uint16_t c),
+RGBmatrixPanel_drawPixelPattern(int16_t x, int16_t y,
+  const RGBmatrixPanel_Pattern *p),
+RGBmatrixPanel_drawColumnPattern(int16_t x, int16_t y, uint8_t bits,
+  uint8_t n, const RGBmatrixPanel_Pattern *fg,
+  const RGBmatrixPanel_Pattern *bg),
+RGBmatrixPanel_makePattern(uint16_t c, RGBmatrixPanel_Pattern *p),
+RGBmatrixPanel_fillRectPattern(int16_t x, int16_t y, int16_t w, int16_t h,
+  const RGBmatrixPanel_Pattern *p),
 RGBmatrixPanel_fillScreen(uint16_t c),
+RGBmatrixPanel_scroll(int16_t dx, int16_t dy, uint16_t c),
+RGBmatrixPanel_setCanvas(uint16_t *buf),
+RGBmatrixPanel_convertCanvas(const uint16_t *buf, int16_t x, int16_t y,
+  int16_t w, int16_t h),
 RGBmatrixPanel_updateDisplay(void),
-RGBmatrixPanel_swapBuffers(bool);
+RGBmatrixPanel_swapBuffers(bool),
+RGBmatrixPanel_setSwapCallback(void (*fn)(void)),
+RGBmatrixPanel_setRowSource(void (*fn)(uint8_t r, uint8_t *dst));
+bool
+RGBmatrixPanel_requestSwap(bool copy),
+RGBmatrixPanel_swapPending(void);
 uint8_t
 *RGBmatrixPanel_backBuffer(void);
+const RGBmatrixPanel_Pattern
+*RGBmatrixPanel_colorPattern(uint16_t c);
 uint16_t
+RGBmatrixPanel_swapSaved(void),
 RGBmatrixPanel_Color333(uint8_t r, uint8_t g, uint8_t b),
 RGBmatrixPanel_Color444(uint8_t r, uint8_t g, uint8_t b),
 RGBmatrixPanel_Color888(uint8_t r, uint8_t g, uint8_t b),
 RGBmatrixPanel_Color888(uint8_t r, uint8_t g, uint8_t b, bool gflag),
 RGBmatrixPanel_ColorHSV(long hue, uint8_t sat, uint8_t val, bool gflag);
 
+#ifdef PALETTEBITS
+void RGBmatrixPanel_setPalette(uint8_t i, uint16_t c);
+#endif
+
 // Init/alloc code common to both constructors:
-void RGBmatrixPanel_init(uint8_t rows, bool dbuf, uint8_t width);
+void RGBmatrixPanel_init(uint8_t rows, bool dbuf, uint8_t width,
+  bool tbuf=false);
 
 #endif // RGBMATRIXPANEL_H
@@ -1,6 +1,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
+#ifndef RGBMATRIX_HOST
 #include <avr/io.h>
+#endif
 #define CLK_PIN 1
 #define CLK_PORT PORTB
 #define CLK_DDR DDRB
@@ -22,10 +24,64 @@
 #define D_PIN   7
 #define D_PORT PORTB
 #define D_DDR DDRB
+
+// A full PORT register is required for the data lines, though only the
+// top 6 output bits are used.  For performance reasons, the port # cannot
+// be changed via library calls, only by changing constants in the library.
+// For similar reasons, the clock pin is only semi-configurable...it can
+// be specified as any pin within a specific PORT register stated below.
+
+ // Ports for "standard" boards (Arduino Uno, Duemilanove, etc.)
+#define DATAPORT PORTD
+#define DATADIR  DDRD
+#define CLKPORT  PORTB
+
+// Bit planes (BCM color depth) per R,G,B channel, 2 to 8.  Each plane
+// fewer roughly doubles the refresh rate and cuts interrupt load; each
+// one more gives twice the levels (up to the 5/6/5 of GFX colors) but
+// costs WIDTH * HEIGHT / 2 bytes per buffer and halves the refresh rate.
+#ifndef nPlanes
+#define nPlanes 4
+#endif
+
+// Palette mode: define as 1 or 2 to store each pixel as a 1 or 2 bit
+// index into a palette of 2 or 4 colors (RGBmatrixPanel_setPalette())
+// rather than as nPlanes bits per channel.  A 32x32 buffer then takes
+// 128 or 256 bytes instead of 1536, so small parts can double-buffer
+// two- or four-color content.  Drawing colors map to the nearest
+// palette entry.  The interleaved scan is not available in this mode.
+// Each row is expanded in the interrupt, in about WIDTH * (10 + 4 *
+// nPlanes) ticks that must fit in the longest plane's interval: use
+// nPlanes of 3 or more at 32x32 and 4 or more at 64 wide, or refresh
+// overruns (a fixed -DMATRIX_WIDTH build refuses to compile).
+//#define PALETTEBITS 2
+
+// Interrupt timing statistics (RGBmatrixPanel_stats()): define as 1 to
+// have the handler time itself from TCNT1 on every call, for roughly 20
+// more ticks a call, with refresh slowed by about 7% to make room.  Off,
+// the timing fields read 0; frame and swap counts are kept either way.
+#ifndef ISRSTATS
+#define ISRSTATS 0
+#endif
+
+// Panel geometry is normally set at run time by the constructor called.
+// Defining both of these (e.g. -DMATRIX_WIDTH=64 -DMATRIX_HEIGHT=32)
+// fixes it at build time instead, for smaller and faster code; the
+// constructor's size arguments are then ignored.
+//#define MATRIX_WIDTH  32
+//#define MATRIX_HEIGHT 32
+
 #define LSBFIRST 0
 #define MSBFIRST 1
 #define HIGH 1
 #define LOW 0
 #define INPUT 0
 #define OUTPUT 1
+
+// Building with -DRGBMATRIX_HOST swaps avr-libc for a stand-in port and
+// timer layer, so the library runs (and can be checked) on a PC.  It has
+// to come last, as it samples the pins defined above.
+#ifdef RGBMATRIX_HOST
+#include "hostsim.h"
+#endif
 #endif
@@ -2,37 +2,56 @@
 // command-line tool that outputs a gamma correction table to stdout;
 // redirect or copy and paste the results into header file for the
 // RGBmatrixPanel library code.
-// Optional 1 parameter: bit depth (default=4, for 16 output levels).
+// Optional parameters: bit depth(s) (default=2 through 8).  Given more
+// than one, the tables are wrapped in #if's, so the library picks the
+// one matching its nPlanes setting (see config.h).
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 
 #define GAMMA 2.5
 
-int planes = 4;
+int planes[7] = { 2, 3, 4, 5, 6, 7, 8 }, ndepths = 7;
 
 int main(int argc, char *argv[])
 {
-	int i, maxval;
+	int i, d, maxval;
 
-	if(argc > 1) planes = atoi(argv[1]);
-
-	maxval = (1 << planes) - 1;
+	if(argc > 1) {
+		for(ndepths=0; (ndepths < argc - 1) && (ndepths < 7); ndepths++)
+			planes[ndepths] = atoi(argv[ndepths + 1]);
+	}
 
 	(void)printf(
 	  "#ifndef _GAMMA_H_\n"
 	  "#define _GAMMA_H_\n\n"
-	  "#include <avr/pgmspace.h>\n\n"
-	  "static const uint8_t PROGMEM gamma_table[] = {\n  ");
+	  "#ifdef __AVR__\n"
+	  " #include <avr/pgmspace.h>\n"
+	  "#endif\n\n");
+
+	for(d=0; d<ndepths; d++) {
+		maxval = (1 << planes[d]) - 1;
+
+		if(ndepths > 1) (void)printf("#%s nPlanes == %d\n",
+		  d ? "elif" : "if", planes[d]);
+		(void)printf("static const uint8_t PROGMEM gamma_table[] = {\n  ");
+
+		for(i=0; i<256; i++) {
+			(void)printf("0x%02x",(int)(pow((float)i / 255.0, GAMMA) *
+			  (float)maxval + 0.5));
+			if(i < 255) (void)printf(((i & 7) == 7) ? ",\n  " : ",");
+		}
 
-	for(i=0; i<256; i++) {
-		(void)printf("0x%02x",(int)(pow((float)i / 255.0, GAMMA) *
-		  (float)maxval + 0.5));
-		if(i < 255) (void)printf(((i & 7) == 7) ? ",\n  " : ",");
+		(void)puts("\n};");
 	}
+	if(ndepths > 1) (void)puts(
+	  "#else\n"
+	  " #error \"No gamma table for this nPlanes; regenerate with extras/gamma.c\"\n"
+	  "#endif");
 
 	(void)puts(
-	  "\n};\n\n"
+	  "\n"
 	  "#endif // _GAMMA_H_");
 
 	return 0;
@@ -0,0 +1,289 @@
+// THIS IS NOT ARDUINO CODE -- DON'T INCLUDE IN YOUR SKETCH.  It's a
+// command-line tool that converts PPM images to PROGMEM data in the
+// frame buffer's own layout, written to stdout as a header file for
+// the sketch.  Either compressed -- one image per animation frame, or
+// just one for a still -- to be played by RGBmatrixPanel_imageOpen()
+// and RGBmatrixPanel_imageNext():
+//
+//   ./imageconvert [-g] name frame0.ppm [frame1.ppm ...] > name.h
+//
+// or, with -p, as a packed bitmap for RGBmatrixPanel_drawPacked(), for
+// a panel of HxW pixels (as panelsim takes it, e.g. 32x64), with the
+// image's top at panel row Y (default 0) and black above and below:
+//
+//   ./imageconvert [-g] -p HxW[+Y] name image.ppm > name.h
+//
+//   g++ -O2 -DRGBMATRIX_HOST imageconvert.cpp -o imageconvert
+//
+// Images are drawn with the library itself and the frame buffer bytes
+// kept, so build this with the same -DnPlanes (and -DPALETTEBITS) as
+// the sketch; the data only draws on a matching build.  Images are
+// binary (P6) PPM files, 8 bits per channel; animation frames are the
+// size of a panel (32x16, 32x32 or 64x32).  -g applies the library's
+// gamma correction to colors.  Any image program can export PPM, e.g.
+// ImageMagick: convert in.png -depth 8 frame0.ppm
+
+#include "../RGBmatrixPanel.cpp"
+#include <ctype.h>
+
+// Next number in a PPM header, skipping white space and comments
+static int ppmNumber(FILE *fp) {
+  int c, n = 0;
+
+  while(((c = getc(fp)) != EOF) && ((c == '#') || isspace(c))) {
+    if(c == '#') while(((c = getc(fp)) != EOF) && (c != '\n'));
+  }
+  if((c < '0') || (c > '9')) return -1;
+  do n = n * 10 + c - '0'; while(((c = getc(fp)) >= '0') && (c <= '9'));
+  return n; // One white space character after maxval was read here
+}
+
+// Read a PPM file, returning its pixels (3 bytes, R,G,B, each) and
+// size, or NULL.
+static uint8_t *readPPM(const char *name, int *w, int *h) {
+  FILE    *fp = fopen(name, "rb");
+  uint8_t *rgb;
+  int      maxval;
+
+  if(!fp) {
+    perror(name);
+    return NULL;
+  }
+  if((getc(fp) != 'P') || (getc(fp) != '6') || ((*w = ppmNumber(fp)) <= 0) ||
+     ((*h = ppmNumber(fp)) <= 0) || ((maxval = ppmNumber(fp)) != 255)) {
+    fprintf(stderr, "%s: not an 8-bit binary (P6) PPM file\n", name);
+    fclose(fp);
+    return NULL;
+  }
+  rgb = (uint8_t *)malloc(*w * *h * 3);
+  if(fread(rgb, 3, *w * *h, fp) != (size_t)(*w * *h)) {
+    fprintf(stderr, "%s: file is short\n", name);
+    free(rgb);
+    rgb = NULL;
+  }
+  fclose(fp);
+  return rgb;
+}
+
+// Set up a panel of w x h pixels, if it is a panel size
+static bool panel(const char *name, int w, int h) {
+  if(!((w == 32) && (h == 16)) && !((h == 32) && ((w == 32) || (w == 64)))) {
+    fprintf(stderr, "%s: %dx%d is not a panel size\n", name, h, w);
+    return false;
+  }
+  RGBmatrixPanel_Adafruit_GFX(w, h);
+  RGBmatrixPanel_init(h / 2, false, w);
+  return true;
+}
+
+// Read a PPM file and draw it into the back buffer at (0,y).  The
+// first frame of an animation sets up the panel for its size; later
+// ones have to be that size too.
+static bool drawPPM(const char *name, bool first, bool anim, int y,
+  bool gamma) {
+  uint8_t *rgb, *ptr;
+  int      w, h;
+
+  if(!(ptr = rgb = readPPM(name, &w, &h))) return false;
+  if(first && anim && !panel(name, w, h)) {
+    free(rgb);
+    return false;
+  }
+  if(anim ? ((w != WIDTH) || (h != HEIGHT)) : ((w > WIDTH) || (y + h > HEIGHT))) {
+    fprintf(stderr, "%s: %dx%d at row %d doesn't fit the %dx%d panel\n",
+      name, h, w, y, HEIGHT, WIDTH);
+    free(rgb);
+    return false;
+  }
+  for(int j=0; j<h; j++) {
+    for(int i=0; i<w; i++, ptr += 3) {
+      RGBmatrixPanel_drawPixel(i, y + j,
+        RGBmatrixPanel_Color888(ptr[0], ptr[1], ptr[2], gamma));
+    }
+  }
+  free(rgb);
+  return true;
+}
+
+// Write data[0..len-1] to stdout as a PROGMEM array
+static void writeArray(const char *name, const uint8_t *data, int len) {
+  printf("#include <avr/pgmspace.h>\n\n"
+    "static const uint8_t PROGMEM %s[] = {", name);
+  for(int i=0; i<len; i++) {
+    printf("%s0x%02X", i ? ((i & 7) ? "," : ",\n  ") : "\n  ", data[i]);
+  }
+  printf("\n};\n");
+}
+
+#ifdef PALETTEBITS
+static const char layout[] = "-bit palette";
+#else
+static const char layout[] = " planes";
+#endif
+
+// -p: one image, drawn onto a black panel, to a packed bitmap of the
+// columns it covers
+static int packed(const char *size, const char *name, const char *file,
+  bool gamma) {
+  int      w = 0, h = 0, y = 0, iw, ih, len, i;
+  uint8_t *rgb, *data, *dst;
+
+  if((sscanf(size, "%dx%d+%d", &h, &w, &y) < 2) || !panel(size, w, h) ||
+     !drawPPM(file, false, false, y, gamma)) return 1;
+  rgb = readPPM(file, &iw, &ih); // Just for its width
+  free(rgb);
+  iw  = (iw + PACKCOLS - 1) & ~(PACKCOLS - 1); // Whole bytes
+  len = PACKEDHEADER + nRows * PACKLINES * (iw / PACKCOLS);
+  data    = dst = (uint8_t *)malloc(len);
+  *dst++  = iw;
+  *dst++  = HEIGHT;
+  *dst++  = IMAGELAYOUT;
+  for(i=0; i<nRows * PACKLINES; i++, dst += iw / PACKCOLS)
+    memcpy(dst, matrixbuff[backindex] + i * (WIDTH / PACKCOLS), iw / PACKCOLS);
+
+  // Draw it back through the library, at each position, to check it:
+  // each column's bits (a whole byte, or in palette mode a share of
+  // one) must land in the panel column it's drawn at
+  uint8_t *want = (uint8_t *)malloc(nRows * ROWBYTES);
+  int      bits = 8 / PACKCOLS, m = (1 << bits) - 1, v, col, sh;
+  for(int x=-iw; x<=WIDTH; x++) {
+    memset(matrixbuff[backindex], 0x55, nRows * ROWBYTES);
+    memcpy(want, matrixbuff[backindex], nRows * ROWBYTES);
+    for(int j=0; j<nRows * PACKLINES; j++) {
+      for(int c=0; c<iw; c++) {
+        if(((col = x + c) < 0) || (col >= WIDTH)) continue;
+        v  = (data[PACKEDHEADER + j * (iw / PACKCOLS) + c / PACKCOLS] >>
+              ((c % PACKCOLS) * bits)) & m;
+        sh = (col % PACKCOLS) * bits;
+        dst = &want[j * (WIDTH / PACKCOLS) + col / PACKCOLS];
+        *dst = (*dst & ~(m << sh)) | (v << sh);
+      }
+    }
+    if(!RGBmatrixPanel_drawPacked(data, x) ||
+       memcmp(want, matrixbuff[backindex], nRows * ROWBYTES)) {
+      fprintf(stderr, "%s: doesn't draw as converted at x=%d\n", file, x);
+      free(want);
+      free(data);
+      return 1;
+    }
+  }
+  free(want);
+
+  printf("// Generated by imageconvert -p: %d columns of a %dx%d panel, %d%s"
+    "\n// %d bytes\n\n", iw, HEIGHT, WIDTH,
+#ifdef PALETTEBITS
+    PALETTEBITS,
+#else
+    nPlanes,
+#endif
+    layout, len);
+  writeArray(name, data, len);
+  fprintf(stderr, "%s: %d columns, %d bytes\n", name, iw, len);
+  return 0;
+}
+
+// Compress buf[0..len-1] as codes (see RGBmatrixPanel_imageNext()),
+// against the previous frame prev, or whole if prev is NULL.  Returns
+// bytes written to out.  Spans still matching prev are skipped, runs
+// of 3 or more equal bytes repeated, anything else copied as is.
+static int encode(const uint8_t *buf, const uint8_t *prev, int len,
+  uint8_t *out) {
+  int i = 0, n, o = 0, lit = -1; // lit: index of open copy code
+
+  while(i < len) {
+    for(n=0; prev && (i + n < len) && (n < 64) &&
+      (buf[i + n] == prev[i + n]); n++);
+    if(n >= 2) {
+      out[o++] = 0xC0 | (n - 1);
+      i       += n;
+      lit      = -1;
+      continue;
+    }
+    for(n=1; (i + n < len) && (n < 65) && (buf[i + n] == buf[i]); n++);
+    if(n >= 3) {
+      out[o++] = 0x80 | (n - 2);
+      out[o++] = buf[i];
+      i       += n;
+      lit      = -1;
+      continue;
+    }
+    if((lit < 0) || (out[lit] == 0x7F)) { // Open a new copy code
+      lit      = o;
+      out[o++] = 0xFF;                    // (becomes 0x00 below)
+    }
+    out[lit]++;
+    out[o++] = buf[i++];
+  }
+  return o;
+}
+
+int main(int argc, char *argv[]) {
+  bool        gamma = false;
+  int         arg = 1, len = 0, total = 0, nframes, f, i;
+  uint8_t    *drawn = NULL, *data = NULL;
+  const char *name;
+
+  if((argc > arg) && !strcmp(argv[arg], "-g")) {
+    gamma = true;
+    arg++;
+  }
+  if((argc - arg == 4) && !strcmp(argv[arg], "-p"))
+    return packed(argv[arg + 1], argv[arg + 2], argv[arg + 3], gamma);
+  if((argc - arg < 2) || (argv[arg][0] == '-')) {
+    fprintf(stderr, "Usage: %s [-g] name frame0.ppm [frame1.ppm ...]\n"
+      "       %s [-g] -p HxW[+Y] name image.ppm\n", argv[0], argv[0]);
+    return 1;
+  }
+  name    = argv[arg++];
+  nframes = argc - arg;
+  if(nframes > 0xFFFF) {
+    fprintf(stderr, "%s: too many frames\n", argv[0]);
+    return 1;
+  }
+
+  for(f=0; f<nframes; f++) {
+    if(!drawPPM(argv[arg + f], !f, true, 0, gamma)) return 1;
+    if(!f) {
+      len   = nRows * ROWBYTES;
+      drawn = (uint8_t *)malloc(nframes * len);
+      // Worst case, all copy codes: a code byte per 128 bytes
+      data = (uint8_t *)malloc(IMAGEHEADER + nframes * (len + len / 128 + 1));
+      data[0] = WIDTH;
+      data[1] = HEIGHT;
+      data[2] = IMAGELAYOUT;
+      data[3] = nframes & 0xFF;
+      data[4] = nframes >> 8;
+      total   = IMAGEHEADER;
+    }
+    memcpy(&drawn[f * len], matrixbuff[backindex], len);
+    total += encode(&drawn[f * len], f ? &drawn[(f - 1) * len] : NULL, len,
+      &data[total]);
+  }
+
+  // Play it back through the library, twice round, to check it decodes
+  // as drawn
+  RGBmatrixPanel_Image im;
+  memset(matrixbuff[backindex], 0x55, len);
+  if(!RGBmatrixPanel_imageOpen(&im, data)) return 1;
+  for(i=0; i<nframes * 2; i++) {
+    f = RGBmatrixPanel_imageNext(&im);
+    if((f != i % nframes) || memcmp(&drawn[f * len], matrixbuff[backindex], len)) {
+      fprintf(stderr, "%s: frame %d does not decode as drawn\n", argv[0], f);
+      return 1;
+    }
+  }
+
+  printf("// Generated by imageconvert: %d frame%s, %dx%d, %d%s\n"
+    "// %d bytes (%d uncompressed)\n\n", nframes, (nframes > 1) ? "s" : "",
+    HEIGHT, WIDTH,
+#ifdef PALETTEBITS
+    PALETTEBITS,
+#else
+    nPlanes,
+#endif
+    layout, total, nframes * len);
+  writeArray(name, data, total);
+  fprintf(stderr, "%s: %d frames, %d bytes, %d uncompressed\n", name,
+    nframes, total, nframes * len);
+  return 0;
+}
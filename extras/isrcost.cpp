@@ -0,0 +1,118 @@
+// THIS IS NOT ARDUINO CODE -- DON'T INCLUDE IN YOUR SKETCH.  It's a
+// command-line tool that reports the refresh rate and interrupt load of
+// RGBmatrixPanel_updateDisplay() for each supported panel size, with the
+// normal and the interleaved (begin(true)) scan.  The handler is run in
+// the host simulator (hostsim.h): interval lengths come from what it
+// actually programs into ICR1, and its cost from the ISRTICKS() notes
+// on each of its paths plus the measured interrupt entry/exit overhead.
+// Ticks are CPU cycles (Timer1 is unprescaled), so one run covers any
+// F_CPU.
+//
+//   g++ -O2 -DRGBMATRIX_HOST isrcost.cpp -o isrcost
+//
+// Add -DnPlanes=N to compare color depths, or -DMATRIX_WIDTH=..
+// -DMATRIX_HEIGHT=.. to see a build with fixed geometry (config.h);
+// only that panel size is reported then.
+//   ./isrcost [F_CPU ...]          e.g. ./isrcost 8000000 16000000
+
+#include "../RGBmatrixPanel.cpp"
+
+#define MAXPLANES 8
+
+static struct {
+  bool     active;
+  uint8_t  shown;               // Plane being displayed
+  uint32_t count[MAXPLANES];    // Interrupts seen per displayed plane
+  uint64_t interval[MAXPLANES]; // Ticks from one interrupt to the next
+  uint64_t busy[MAXPLANES];     // Ticks spent in the handler
+  uint32_t overruns;            // Handler outlasted its interval
+  uint32_t calls;
+} stats;
+
+// Each handler call latches the plane loaded on the previous call, so
+// it starts that plane's display interval and then loads the next one.
+// On the chip, the interval runs ICR1 + 1 ticks from the TCNT1 reset,
+// itself about one entry latency after the overflow -- unless the
+// rest of the handler runs longer than that, and the next, already
+// pending, interrupt has to wait for it to return.
+static void onISR(void) {
+  uint32_t busy     = HOSTSIM_LATENCY * 2 + hostsim_isrticks,
+           tail     = hostsim_isrticks + HOSTSIM_LATENCY,
+           interval = (uint32_t)ICR1 + 1;
+
+  if(stats.active) {
+    if(tail > interval) {
+      interval = tail;
+      stats.overruns++;
+    }
+    stats.count[stats.shown]++;
+    stats.interval[stats.shown] += HOSTSIM_LATENCY + interval;
+    stats.busy[stats.shown]     += busy;
+    stats.calls++;
+  }
+  stats.shown = plane;
+}
+
+static void report(int16_t w, int16_t h, bool interleave, int nf,
+  double *fcpu) {
+  uint64_t rowticks = 0, rowbusy = 0;
+  uint8_t  p;
+
+#ifdef MATRIX_WIDTH
+  if((w != WIDTH) || (h != HEIGHT)) return;
+#endif
+  RGBmatrixPanel_Adafruit_GFX(w, h);
+  RGBmatrixPanel_init(h / 2, false, w);
+
+  memset(&stats, 0, sizeof(stats));
+  hostsim_isrhook = onISR;
+  RGBmatrixPanel_begin(interleave);
+  hostsim_run(200000); // Settle
+  hostsim_panelReset();
+  stats.active = true;
+  while(stats.calls < (uint32_t)nRows * nPlanes * 8) hostsim_run(1000);
+  hostsim_isrhook = NULL;
+  TCCR1B = 0; // Stop this panel's timer
+
+  printf("%dx%d panel, %d rows, %d planes, %s scan\n", h, w, nRows, nPlanes,
+    interleave ? "interleaved" : "normal");
+  printf("  plane  interval    isr  weight\n");
+  for(p=0; p<nPlanes; p++) {
+    double interval = (double)stats.interval[p] / stats.count[p],
+           busy     = (double)stats.busy[p]     / stats.count[p];
+    printf("  %5d  %8.0f  %5.0f  %6.2f\n", p, interval, busy,
+      interval * stats.count[0] / stats.interval[0]);
+    rowticks += stats.interval[p] / stats.count[p];
+    rowbusy  += stats.busy[p]     / stats.count[p];
+  }
+  printf("  %llu ticks/row, %llu ticks/frame, interrupt load %.1f%%",
+    (unsigned long long)rowticks, (unsigned long long)rowticks * nRows,
+    100.0 * rowbusy / rowticks);
+  if(stats.overruns) printf(", %u OVERRUNS", stats.overruns);
+  printf("\n  longest a row stays dark: %llu ticks\n",
+    (unsigned long long)hostsim_panel.darkmax);
+  for(int i=0; i<nf; i++) {
+    printf("  F_CPU %5.1f MHz: %6.1f Hz refresh, dark gap %5.2f ms, "
+      "%4.1f%% CPU left to loop()\n",
+      fcpu[i] / 1e6, fcpu[i] / (double)(rowticks * nRows),
+      hostsim_panel.darkmax * 1e3 / fcpu[i],
+      100.0 - 100.0 * rowbusy / rowticks);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  double fcpu[16] = { 8e6, 16e6 };
+  int    nf       = 2;
+
+  if(argc > 1) {
+    for(nf=0; (nf < argc - 1) && (nf < 16); nf++) fcpu[nf] = atof(argv[nf + 1]);
+  }
+
+  for(int interleave=0; interleave<2; interleave++) {
+    report(32, 16, interleave, nf, fcpu);
+    report(32, 32, interleave, nf, fcpu);
+    report(64, 32, interleave, nf, fcpu);
+  }
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+// THIS IS NOT ARDUINO CODE -- DON'T INCLUDE IN YOUR SKETCH.  It's a
+// command-line tool that streams images to a panel over a serial line,
+// for a sketch calling RGBmatrixPanel_serialBegin() and then
+// RGBmatrixPanel_serialPoll() from loop():
+//
+//   ./matrixsend [-g] [-b baud] [-f fps] [-l] device frame0.ppm [...]
+//   ./matrixsend [-g] [-b baud] [-f fps] device - < frames.rgb
+//
+//   g++ -O2 -DRGBMATRIX_HOST matrixsend.cpp -o matrixsend
+//
+// Frames are drawn here with the library itself, and the frame buffer
+// bytes sent (see "Serial frame streaming" in RGBmatrixPanel.cpp), so
+// build this with the same -DnPlanes (and -DPALETTEBITS) as the sketch;
+// the panel is asked for its size and layout first, and refuses to go
+// on if they don't match.  After the first, only the lines and columns
+// that changed from one frame to the next are sent.  Images are binary
+// (P6) PPM files, 8 bits per channel, drawn at the top left on black
+// (as for imageconvert, any image program can export these); with -
+// instead, raw R,G,B frames of exactly the panel's size are read from
+// stdin until it ends, e.g. decoded from a video:
+//
+//   ffmpeg -i in.mp4 -f rawvideo -pix_fmt rgb24 -s 32x32 - |
+//     ./matrixsend -g -f 30 /dev/ttyUSB0 -
+//
+// -b sets the baud rate (default 115200), -f paces frames to that rate
+// (default: as fast as the line and the panel take them), -l loops the
+// PPM frames until stopped, -g applies the library's gamma correction.
+// The device can be a pty from extras/serialsim.cpp.
+
+#include "../RGBmatrixPanel.cpp"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+static int      fd;
+static uint32_t baud = 115200;
+
+// Next number in a PPM header, skipping white space and comments
+static int ppmNumber(FILE *fp) {
+  int c, n = 0;
+
+  while(((c = getc(fp)) != EOF) && ((c == '#') || isspace(c))) {
+    if(c == '#') while(((c = getc(fp)) != EOF) && (c != '\n'));
+  }
+  if((c < '0') || (c > '9')) return -1;
+  do n = n * 10 + c - '0'; while(((c = getc(fp)) >= '0') && (c <= '9'));
+  return n; // One white space character after maxval was read here
+}
+
+// Read a PPM file, returning its pixels (3 bytes, R,G,B, each) and
+// size, or NULL.
+static uint8_t *readPPM(const char *name, int *w, int *h) {
+  FILE    *fp = fopen(name, "rb");
+  uint8_t *rgb;
+  int      maxval;
+
+  if(!fp) {
+    perror(name);
+    return NULL;
+  }
+  if((getc(fp) != 'P') || (getc(fp) != '6') || ((*w = ppmNumber(fp)) <= 0) ||
+     ((*h = ppmNumber(fp)) <= 0) || ((maxval = ppmNumber(fp)) != 255)) {
+    fprintf(stderr, "%s: not an 8-bit binary (P6) PPM file\n", name);
+    fclose(fp);
+    return NULL;
+  }
+  rgb = (uint8_t *)malloc(*w * *h * 3);
+  if(fread(rgb, 3, *w * *h, fp) != (size_t)(*w * *h)) {
+    fprintf(stderr, "%s: file is short\n", name);
+    free(rgb);
+    rgb = NULL;
+  }
+  fclose(fp);
+  return rgb;
+}
+
+// Draw w x h R,G,B pixels into the buffer at the top left, on black;
+// whatever is off the panel is cut off.
+static void drawRGB(const uint8_t *rgb, int w, int h, bool gamma) {
+  RGBmatrixPanel_fillScreen(0);
+  for(int j=0; j<h; j++) {
+    for(int i=0; i<w; i++, rgb += 3) {
+      if((i < WIDTH) && (j < HEIGHT))
+        RGBmatrixPanel_drawPixel(i, j,
+          RGBmatrixPanel_Color888(rgb[0], rgb[1], rgb[2], gamma));
+    }
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Read n bytes of reply within the given seconds; false on timeout
+static bool readReply(uint8_t *buf, int n, double secs) {
+  double end = now() + secs;
+
+  while(n > 0) {
+    struct pollfd p = { fd, POLLIN, 0 };
+    double        left = end - now();
+    ssize_t       got;
+    if((left <= 0) || (poll(&p, 1, (int)(left * 1000) + 1) <= 0)) return false;
+    if((got = read(fd, buf, n)) <= 0) {
+      if((got < 0) && (errno == EINTR)) continue;
+      return false;
+    }
+    buf += got;
+    n   -= got;
+  }
+  return true;
+}
+
+// Send a packet of the buffer's lines [line, line + lines) and columns
+// (bytes) [col, col + cols), and wait for the panel to take it, sending
+// it again if it has to.  No lines or columns sends no data.  The
+// reply, nreply bytes from SERIALACK on, goes to reply if it's wanted.
+static bool sendPacket(uint8_t flags, int line, int lines, int col,
+  int cols, uint8_t *reply, int nreply) {
+  static uint8_t pkt[SERIALHEADER + 256 * 64 + 2];
+  uint8_t *p = pkt, sum1 = 0, sum2 = 0, ack;
+  double   secs;
+
+  if(!reply) {
+    reply  = &ack;
+    nreply = 1;
+  }
+  *p++ = SERIALSYNC;
+  *p++ = flags;
+  *p++ = line;
+  *p++ = lines;
+  *p++ = col;
+  *p++ = cols;
+  *p++ = flags + line + lines + col + cols;
+  if(lines && cols) {
+    for(int j=0; j<lines; j++) {
+      for(int i=0; i<cols; i++) {
+        *p    = matrixbuff[backindex][(line + j) * (WIDTH / PACKCOLS) + col + i];
+        sum2 += (sum1 += *p++);
+      }
+    }
+    *p++ = sum1;
+    *p++ = sum2;
+  }
+  // Line time plus a generous allowance for the swap and the OS
+  secs = (p - pkt + nreply) * 10.0 / baud + 0.5;
+
+  for(int tries=0; tries<4; tries++) {
+    if(write(fd, pkt, p - pkt) != p - pkt) {
+      perror("write");
+      return false;
+    }
+    if(readReply(reply, 1, secs) && (reply[0] == SERIALACK) &&
+       ((nreply < 2) || readReply(reply + 1, nreply - 1, secs))) return true;
+    // NAK, or no answer: let the line go quiet, then try again
+    uint8_t junk[64];
+    while(readReply(junk, 1, 0.1));
+  }
+  fprintf(stderr, "matrixsend: panel doesn't answer\n");
+  return false;
+}
+
+// Send the back buffer: the lines and columns that changed from prev
+// (all of them if prev is NULL), then a swap.  Returns bytes of data.
+static int sendFrame(const uint8_t *prev) {
+  int stride = WIDTH / PACKCOLS, lines = nRows * PACKLINES,
+      top = lines, bottom = -1, left = stride, right = -1;
+
+  for(int j=0; j<lines; j++) {
+    for(int i=0; i<stride; i++) {
+      if(!prev || (matrixbuff[backindex][j * stride + i] != prev[j * stride + i])) {
+        if(j < top)    top    = j;
+        if(j > bottom) bottom = j;
+        if(i < left)   left   = i;
+        if(i > right)  right  = i;
+      }
+    }
+  }
+  if(bottom < 0) // Unchanged; just the swap, to keep time
+    return sendPacket(SERIALSWAP | SERIALCOPY, 0, 0, 0, 0, NULL, 0) ? 0 : -1;
+  if(!sendPacket(SERIALSWAP | SERIALCOPY, top, bottom - top + 1, left,
+    right - left + 1, NULL, 0)) return -1;
+  return (bottom - top + 1) * (right - left + 1);
+}
+
+// Open the line raw at the baud rate (if it's a terminal; a pty's
+// speed doesn't matter)
+static bool openLine(const char *dev) {
+  static const struct { uint32_t baud; speed_t speed; } speeds[] = {
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+    { 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 },
+#ifdef B500000
+    { 500000, B500000 }, { 1000000, B1000000 },
+#endif
+  };
+  struct termios t;
+  unsigned       i;
+
+  if((fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+    perror(dev);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK); // Open done
+  if(tcgetattr(fd, &t)) return true;
+  for(i=0; (i < sizeof(speeds) / sizeof(speeds[0])) && (speeds[i].baud != baud); i++);
+  if(i == sizeof(speeds) / sizeof(speeds[0])) {
+    fprintf(stderr, "%s: no %u baud\n", dev, baud);
+    return false;
+  }
+  cfmakeraw(&t);
+  cfsetispeed(&t, speeds[i].speed);
+  cfsetospeed(&t, speeds[i].speed);
+  t.c_cflag |= CLOCAL | CREAD;
+  tcsetattr(fd, TCSANOW, &t);
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  bool     gamma = false, loop = false;
+  double   fps = 0, next, start;
+  int      arg = 1, frames = 0, bytes = 0, n, w, h;
+  uint8_t  info[4], *prev, *rgb;
+
+  for(; (arg < argc) && (argv[arg][0] == '-') && argv[arg][1]; arg++) {
+    if(!strcmp(argv[arg], "-g"))                      gamma = true;
+    else if(!strcmp(argv[arg], "-l"))                 loop  = true;
+    else if(!strcmp(argv[arg], "-b") && (arg + 1 < argc)) baud = atol(argv[++arg]);
+    else if(!strcmp(argv[arg], "-f") && (arg + 1 < argc)) fps  = atof(argv[++arg]);
+    else break;
+  }
+  if((argc - arg < 2) || (argv[arg][0] == '-') || !baud) {
+    fprintf(stderr,
+      "Usage: %s [-g] [-b baud] [-f fps] [-l] device frame0.ppm [...]\n"
+      "       %s [-g] [-b baud] [-f fps] device - < frames.rgb\n",
+      argv[0], argv[0]);
+    return 1;
+  }
+  if(!openLine(argv[arg])) return 1;
+
+  // Set up to draw as the panel's build would
+  if(!sendPacket(SERIALQUERY, 0, 0, 0, 0, info, 4)) return 1;
+  w = info[1];
+  h = info[2];
+  if(!((w == 32) && (h == 16)) && !((h == 32) && ((w == 32) || (w == 64)))) {
+    fprintf(stderr, "%s: reports a %dx%d panel\n", argv[arg], h, w);
+    return 1;
+  }
+  if(info[3] != IMAGELAYOUT) {
+    fprintf(stderr, "%s: panel's frame buffer layout is 0x%02X, this build's "
+      "0x%02X; rebuild with its -DnPlanes (or -DPALETTEBITS)\n", argv[arg],
+      info[3], IMAGELAYOUT);
+    return 1;
+  }
+  RGBmatrixPanel_Adafruit_GFX(w, h);
+  RGBmatrixPanel_init(h / 2, false, w);
+  prev = (uint8_t *)malloc(nRows * ROWBYTES);
+  rgb  = (uint8_t *)malloc(WIDTH * HEIGHT * 3);
+  arg++;
+
+  start = next = now();
+  for(int f=0; ; f++) {
+    if(!strcmp(argv[arg], "-")) {
+      if(fread(rgb, 3, WIDTH * HEIGHT, stdin) != (size_t)(WIDTH * HEIGHT)) break;
+      drawRGB(rgb, WIDTH, HEIGHT, gamma);
+    } else {
+      int      iw, ih;
+      uint8_t *img;
+      if(arg + f >= argc) {
+        if(!loop) break;
+        f = 0;
+      }
+      if(!(img = readPPM(argv[arg + f], &iw, &ih))) return 1;
+      drawRGB(img, iw, ih, gamma);
+      free(img);
+    }
+    if(fps > 0) { // Hold each frame back until its time
+      double wait = next - now();
+      if(wait > 0) usleep((useconds_t)(wait * 1e6));
+      next += 1.0 / fps;
+    }
+    if((n = sendFrame(frames ? prev : NULL)) < 0) return 1;
+    memcpy(prev, matrixbuff[backindex], nRows * ROWBYTES);
+    bytes += n;
+    frames++;
+  }
+
+  fprintf(stderr, "%d frames, %d bytes of data, %.1f frames/s\n", frames,
+    bytes, frames / (now() - start));
+  return 0;
+}
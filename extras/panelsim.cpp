@@ -0,0 +1,1302 @@
+// THIS IS NOT ARDUINO CODE -- DON'T INCLUDE IN YOUR SKETCH.  It's a
+// command-line tool that runs the RGBmatrixPanel library on a PC, using
+// the stand-in ports and timer in hostsim.h.  It draws a test scene,
+// shows it through the real interrupt code on a virtual panel, checks
+// the panel against the frame buffer, writes what the panel showed to a
+// PPM image, checks the fast drawing paths against plain drawPixel()
+// and times the main drawing calls.  Exit status is nonzero if the
+// panel and the frame buffer disagree, or any fast path draws
+// differently.
+//
+//   g++ -O2 -DRGBMATRIX_HOST panelsim.cpp -o panelsim
+//   ./panelsim [16x32|32x32|32x64][i] [out.ppm]
+//
+// A trailing 'i' on the size (e.g. 32x32i) uses the interleaved scan.
+//
+// With -DMATRIX_WIDTH=.. -DMATRIX_HEIGHT=.. (see config.h) the size is
+// fixed at build time and the geometry argument must match it.
+
+#include "../RGBmatrixPanel.cpp"
+#include "../Fonts/FreeSans24pt7b.h"
+#include "../Fonts/Picopixel.h"
+#include <time.h>
+
+static void scene(void) {
+  RGBmatrixPanel_fillScreen(RGBmatrixPanel_Color333(0, 0, 1));
+  RGBmatrixPanel_drawRect(0, 0, _width, _height, RGBmatrixPanel_Color333(7, 7, 0));
+  RGBmatrixPanel_drawLine(0, 0, _width-1, _height-1, RGBmatrixPanel_Color333(7, 0, 0));
+  RGBmatrixPanel_drawLine(_width-1, 0, 0, _height-1, RGBmatrixPanel_Color333(7, 0, 0));
+  RGBmatrixPanel_fillCircle(_width/2, _height/2, _height/4, RGBmatrixPanel_Color333(7, 0, 7));
+  // One pixel of every 4-bit level on each channel
+  for(uint8_t i=0; i<16; i++) {
+    RGBmatrixPanel_drawPixel(1 + i, 1, RGBmatrixPanel_Color444(i, 0, 0));
+    RGBmatrixPanel_drawPixel(1 + i, 2, RGBmatrixPanel_Color444(0, i, 0));
+    RGBmatrixPanel_drawPixel(1 + i, _height-2, RGBmatrixPanel_Color444(0, 0, i));
+  }
+  RGBmatrixPanel_setCursor(2, 4);
+  RGBmatrixPanel_setTextColor(RGBmatrixPanel_Color333(0, 7, 7));
+  RGBmatrixPanel_print("Sim");
+}
+
+// Sample whole frames only: the interleaved scan spreads each row's
+// planes over the frame, so a part frame would skew its brightness.
+// Called after every interrupt; the one after a frame's first data was
+// loaded latches it, and starts the frame on the panel.
+#define SAMPLEFRAMES 4
+static int      frames;
+static bool     armed;
+static uint8_t *sample;
+
+static void onISR(void) {
+  bool start = armed;
+  armed = (plane == 0) && ((scaninterleave ? scanblock : row) == 0);
+  if(start) {
+    if(frames == 1) hostsim_panelReset();
+    if(frames == 1 + SAMPLEFRAMES)
+      hostsim_panelImage(WIDTH, HEIGHT, (1 << nPlanes) - 1, sample);
+    frames++;
+  }
+}
+
+#ifdef PALETTEBITS
+// The frame buffer holds palette indices; each pixel should show its
+// entry's color at nPlanes bits per channel, widened as makePattern().
+static void decodePalette(const uint8_t *buf, uint8_t *rgb) {
+  for(int y=0; y<HEIGHT; y++) {
+    for(int x=0; x<WIDTH; x++) {
+      uint8_t  half  = (y >= nRows),
+               shift = ((x * 2 * PALETTEBITS) & 7) + half * PALETTEBITS;
+      uint16_t c = palette[(buf[(y % nRows) * ROWBYTES +
+        ((x * 2 * PALETTEBITS) >> 3)] >> shift) & ((1 << PALETTEBITS) - 1)];
+      *rgb++ = (((c >> 8) & 0xF8) | (c >> 13))         >> (8 - nPlanes);
+      *rgb++ = (((c >> 3) & 0xFC) | ((c >> 9) & 0x03)) >> (8 - nPlanes);
+      *rgb++ = (((c << 3) & 0xF8) | ((c >> 2) & 0x07)) >> (8 - nPlanes);
+    }
+  }
+}
+#endif
+
+#ifndef PALETTEBITS
+// A row source (RGBmatrixPanel_setRowSource()) doing what the interrupt
+// does itself: the panel should show the same either way.
+static void unpackRow(uint8_t r, uint8_t *dst) {
+  const uint8_t *ptr = matrixbuff[frontindex] + r * ROWBYTES;
+  uint8_t        p   = 0;
+
+  if(PLANEBYTES < nPlanes) { // Plane 0 packed into the others' low bits
+    for(int i=0; i<WIDTH; i++) {
+      *dst++ = ( ptr[i]           << 6)         |
+               ((ptr[i+WIDTH]     << 4) & 0x30) |
+               ((ptr[i+WIDTH * 2] << 2) & 0x0C);
+    }
+    p = 1;
+  }
+  memcpy(dst, ptr, (nPlanes - p) * WIDTH);
+}
+#endif
+
+// Show the front buffer for a few frames and count the channels that
+// don't match want[].  With change, the row source is switched to fn
+// part way through the second of them.
+static int sampleFrames(uint8_t *shown, const uint8_t *want, const char *what,
+  bool change = false, void (*fn)(uint8_t r, uint8_t *dst) = NULL) {
+  int errors = 0;
+
+  frames          = 0;
+  armed           = false;
+  sample          = shown;
+  hostsim_isrhook = onISR;
+  while(frames <= 1 + SAMPLEFRAMES) {
+    hostsim_run(F_CPU / 1000);
+    if(change && (frames == 2)) {
+      RGBmatrixPanel_setRowSource(fn);
+      change = false;
+    }
+  }
+  hostsim_isrhook = NULL;
+  for(int i=0; i<WIDTH * HEIGHT * 3; i++) {
+    if(shown[i] != want[i]) {
+      if(errors++ < 10) {
+        fprintf(stderr, "%s: mismatch at (%d,%d) channel %d: shown %d, "
+          "buffer %d\n", what, (i / 3) % WIDTH, (i / 3) / WIDTH, i % 3,
+          shown[i], want[i]);
+      }
+    }
+  }
+  printf("%s: %d mismatched channels\n", what, errors);
+  return errors;
+}
+
+// Nanoseconds per call of fn(), best of a few rounds
+static double bench(void (*fn)(void), int n) {
+  struct timespec t0, t1;
+  double          best = 1e30, ns;
+  for(int round=0; round<5; round++) {
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int i=0; i<n; i++) fn();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n;
+    if(ns < best) best = ns;
+  }
+  return best;
+}
+
+static void benchPixels(void) {
+  for(int16_t y=0; y<_height; y++)
+    for(int16_t x=0; x<_width; x++) RGBmatrixPanel_drawPixel(x, y, 0x1234);
+}
+static void benchFillRect(void) { RGBmatrixPanel_fillRect(1, 1, _width-2, _height-2, 0x1234); }
+static void benchFillScreen(void) { RGBmatrixPanel_fillScreen(0x4321); }
+static void benchHLine(void) { RGBmatrixPanel_drawFastHLine(0, 3, _width, 0x1234); }
+static void benchVLine(void) { RGBmatrixPanel_drawFastVLine(3, 0, _height, 0x1234); }
+static void benchLine(void) { RGBmatrixPanel_drawLine(0, 0, _width-1, _height-1, 0x1234); }
+static void benchCircle(void) { RGBmatrixPanel_fillCircle(_width/2, _height/2, _height/2-1, 0x1234); }
+static void benchText(void) {
+  RGBmatrixPanel_setCursor(0, 0);
+  RGBmatrixPanel_setTextColor(0x1234);
+  RGBmatrixPanel_print("Hello");
+}
+static void benchFontText(void) { // Mostly off the right edge, as scrolling
+  RGBmatrixPanel_setFont(&FreeSans24pt7b);
+  RGBmatrixPanel_setCursor(0, _height - 1);
+  RGBmatrixPanel_setTextColor(0x1234);
+  RGBmatrixPanel_print("Hello");
+  RGBmatrixPanel_setFont(NULL);
+}
+static void benchTextBg(void) {
+  RGBmatrixPanel_setCursor(0, 0);
+  RGBmatrixPanel_setTextColor(0x1234, 0x0042);
+  RGBmatrixPanel_print("Hello");
+}
+static void benchTextOpaque(void) { // A readout redrawn in place
+  RGBmatrixPanel_setFont(&FreeSans24pt7b);
+  RGBmatrixPanel_drawTextOpaque("42", 0, _height - 1, 0x1234, 0x0042,
+    0, 0, _width, _height);
+  RGBmatrixPanel_setFont(NULL);
+}
+static const char            marquee[] = "Scrolling marquee text";
+static RGBmatrixPanel_LaidGlyph   marqueeglyphs[sizeof(marquee)];
+static RGBmatrixPanel_TextLayout  marqueelayout;
+static void benchMarqueePrint(void) {
+  RGBmatrixPanel_setTextWrap(false);
+  RGBmatrixPanel_setCursor(-40, 0);
+  RGBmatrixPanel_setTextColor(0x1234);
+  RGBmatrixPanel_print(marquee);
+  RGBmatrixPanel_setTextWrap(true);
+}
+static void benchMarqueeLayout(void) {
+  RGBmatrixPanel_drawLayout(&marqueelayout, -40, 0, 0x1234);
+}
+static void benchScrollH(void) { RGBmatrixPanel_scroll(-1, 0, 0); }
+static void benchScrollV(void) { RGBmatrixPanel_scroll(0, -1, 0); }
+static uint16_t              ballbitmap[8 * 8];
+static RGBmatrixPanel_Sprite ball;
+static RGBmatrixPanel_Layers layers;
+static void benchSprite(void) { // One 8x8 sprite moved a pixel per frame
+  ball.x = (ball.x + 1) % _width;
+  RGBmatrixPanel_layersCompose(&layers);
+}
+static uint16_t canvas[64 * 32];
+static void benchCanvasPixels(void) {
+  RGBmatrixPanel_setCanvas(canvas);
+  benchPixels();
+  RGBmatrixPanel_setCanvas(NULL);
+}
+static void benchConvert(void) {
+  RGBmatrixPanel_convertCanvas(canvas, 0, 0, _width, _height);
+}
+static void benchRGBBitmap(void) {
+  RGBmatrixPanel_drawRGBBitmap(0, 0, canvas, _width, _height);
+}
+static uint8_t packed[PACKEDHEADER + 64 * 16 * 8];
+static void benchPacked(void) { RGBmatrixPanel_drawPacked(packed, 0); }
+static void benchPackedPart(void) { RGBmatrixPanel_drawPacked(packed, 16); }
+
+// Reference checks: each fast drawing path against the same drawing
+// done a pixel at a time with drawPixel(), comparing the back buffers.
+// Both start from the same background of random pixels, so a fast path
+// that touches anything it shouldn't shows up too.  Parameters are
+// random, and many of them run off the display.
+#if PLANEBYTES < nPlanes
+#define REFMASK 0xFF
+#else
+#define REFMASK 0xFC // Bits 0-1 unused; fillScreen() may set them
+#endif
+static uint32_t refstate = 1;
+static uint8_t *refgot;
+static char     refcase[128]; // What's being drawn, for the error message
+static int      refcases, reffails;
+
+static uint16_t refRand(void) {
+  refstate = refstate * 1103515245 + 12345;
+  return refstate >> 16;
+}
+static int16_t refRange(int16_t lo, int16_t hi) { // lo to hi inclusive
+  return lo + (int16_t)(refRand() % (hi - lo + 1));
+}
+
+// The background: a color per pixel, from seed and position only, so a
+// check can also work out what a moved pixel should be
+static uint16_t refseed;
+static uint16_t refColor(int16_t x, int16_t y) {
+  uint32_t h = (refseed * 2654435761u) ^ (x * 40503u) ^ (y * 9973u << 8);
+  return (h ^ (h >> 15)) * 0x9E37;
+}
+static void refBackground(void) {
+  for(int16_t y=0; y<_height; y++)
+    for(int16_t x=0; x<_width; x++) RGBmatrixPanel_drawPixel(x, y, refColor(x, y));
+}
+
+// Draw with fast(), then with slow(), on the same background; count a
+// failure if the back buffers differ.  refcase says what was drawn.
+static void refCheck(void (*fast)(void), void (*slow)(void)) {
+  int n = nRows * ROWBYTES, i;
+
+  refseed = refRand();
+  refBackground();
+  fast();
+  memcpy(refgot, matrixbuff[backindex], n);
+  refBackground();
+  slow();
+  for(i=0; (i < n) && !((refgot[i] ^ matrixbuff[backindex][i]) & REFMASK); i++);
+  refcases++;
+  if((i < n) && (reffails++ < 10)) {
+    fprintf(stderr, "%s, rotation %d: differs from drawPixel() at byte %d\n",
+      refcase, RGBmatrixPanel_getRotation(), i);
+  }
+}
+
+// Filled rectangles and straight lines, straight into the planes
+static int16_t  rx, ry, rw, rh;
+static uint16_t rc;
+static void fastFillRect(void) { RGBmatrixPanel_fillRect(rx, ry, rw, rh, rc); }
+static void refRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t c) {
+  for(int16_t j=0; j<h; j++)
+    for(int16_t i=0; i<w; i++) RGBmatrixPanel_drawPixel(x + i, y + j, c);
+}
+static void slowFillRect(void) { refRect(rx, ry, rw, rh, rc); }
+static void fastHLine(void) { RGBmatrixPanel_drawFastHLine(rx, ry, rw, rc); }
+static void slowHLine(void) { // Negative widths extend left
+  for(int16_t i=0; i<abs(rw); i++)
+    RGBmatrixPanel_drawPixel((rw < 0) ? rx - i : rx + i, ry, rc);
+}
+static void fastVLine(void) { RGBmatrixPanel_drawFastVLine(rx, ry, rh, rc); }
+static void slowVLine(void) {
+  for(int16_t j=0; j<abs(rh); j++)
+    RGBmatrixPanel_drawPixel(rx, (rh < 0) ? ry - j : ry + j, rc);
+}
+static void fastFillScreen(void) { RGBmatrixPanel_fillScreen(rc); }
+static void slowFillScreen(void) { rx = ry = 0; rw = _width; rh = _height; slowFillRect(); }
+static void refFills(void) {
+  for(int n=0; n<200; n++) {
+    rx = refRange(-8, _width + 4);
+    ry = refRange(-8, _height + 4);
+    rw = refRange(-4, _width + 8);
+    rh = refRange(-4, _height + 8);
+    rc = (n & 7) ? refRand() : ((n & 8) ? 0xFFFF : 0);
+    snprintf(refcase, sizeof(refcase), "fillRect(%d, %d, %d, %d, 0x%04X)",
+      rx, ry, rw, rh, rc);
+    refCheck(fastFillRect, slowFillRect);
+    snprintf(refcase, sizeof(refcase), "drawFastHLine(%d, %d, %d, 0x%04X)",
+      rx, ry, rw, rc);
+    refCheck(fastHLine, slowHLine);
+    snprintf(refcase, sizeof(refcase), "drawFastVLine(%d, %d, %d, 0x%04X)",
+      rx, ry, rh, rc);
+    refCheck(fastVLine, slowVLine);
+  }
+  for(int n=0; n<8; n++) {
+    rc = (n < 2) ? (n ? 0xFFFF : 0) : refRand();
+    snprintf(refcase, sizeof(refcase), "fillScreen(0x%04X)", rc);
+    refCheck(fastFillScreen, slowFillScreen);
+  }
+}
+
+// Single pixels.  drawPixel() is itself the pattern path, so it's also
+// checked against the 5-6-5 color, decoded back out of the buffer
+// without makePattern(): the pixel's own levels, and all others as they
+// were.  (Not in palette mode, where colors map to palette entries.)
+static RGBmatrixPanel_Pattern refpattern;
+static void fastPixelPattern(void) {
+  RGBmatrixPanel_makePattern(rc, &refpattern);
+  RGBmatrixPanel_drawPixel(0, 0, ~rc); // The cached pattern mustn't matter
+  RGBmatrixPanel_drawPixelPattern(rx, ry, &refpattern);
+}
+static void slowPixelPattern(void) {
+  RGBmatrixPanel_drawPixel(0, 0, ~rc);
+  RGBmatrixPanel_drawPixel(rx, ry, rc);
+}
+static void refPixels(void) {
+#ifndef PALETTEBITS
+  int      n = WIDTH * HEIGHT * 3;
+  uint8_t *before = (uint8_t *)malloc(n), *after = (uint8_t *)malloc(n);
+#endif
+
+  for(int k=0; k<300; k++) {
+    rx = refRange(-2, _width + 1);
+    ry = refRange(-2, _height + 1);
+    rc = refRand();
+    snprintf(refcase, sizeof(refcase), "drawPixelPattern(%d, %d, 0x%04X)",
+      rx, ry, rc);
+    refCheck(fastPixelPattern, slowPixelPattern);
+#ifndef PALETTEBITS
+    int16_t px = rx, py = ry, t, i;
+    refseed = refRand();
+    refBackground();
+    hostsim_decodeBuffer(matrixbuff[backindex], WIDTH, nRows, nPlanes, before);
+    RGBmatrixPanel_drawPixel(rx, ry, rc);
+    hostsim_decodeBuffer(matrixbuff[backindex], WIDTH, nRows, nPlanes, after);
+    switch(RGBmatrixPanel_getRotation()) { // As drawPixel() maps it
+     case 1: t = px; px = WIDTH - 1 - py; py = t;          break;
+     case 2: px = WIDTH - 1 - px; py = HEIGHT - 1 - py;    break;
+     case 3: t = px; px = py; py = HEIGHT - 1 - t;         break;
+    }
+    if((rx >= 0) && (rx < _width) && (ry >= 0) && (ry < _height)) {
+      uint8_t *p = &before[(py * WIDTH + px) * 3];
+      p[0] = (((rc >> 8) & 0xF8) | (rc >> 13))         >> (8 - nPlanes);
+      p[1] = (((rc >> 3) & 0xFC) | ((rc >> 9) & 0x03)) >> (8 - nPlanes);
+      p[2] = (((rc << 3) & 0xF8) | ((rc >> 2) & 0x07)) >> (8 - nPlanes);
+    }
+    for(i=0; (i < n) && (before[i] == after[i]); i++);
+    refcases++;
+    if((i < n) && (reffails++ < 10)) {
+      fprintf(stderr, "drawPixel(%d, %d, 0x%04X), rotation %d: pixel "
+        "(%d,%d) decodes wrong\n", rx, ry, rc, RGBmatrixPanel_getRotation(),
+        (i / 3) % WIDTH, (i / 3) / WIDTH);
+    }
+#endif
+  }
+#ifndef PALETTEBITS
+  free(before);
+  free(after);
+#endif
+}
+
+// Font columns, and classic-font characters built from them (or from
+// fillRect() when scaled).  Each character is drawn just after one in
+// another background color, and in palette mode after a palette
+// change, so patterns kept from before would show.
+static uint16_t rb;
+static uint8_t  rbits, rn, rch, rsx, rsy;
+static RGBmatrixPanel_Pattern refback;
+static void fastColumn(void) {
+  RGBmatrixPanel_makePattern(rc, &refpattern);
+  RGBmatrixPanel_makePattern(rb, &refback);
+  RGBmatrixPanel_drawColumnPattern(rx, ry, rbits, rn, &refpattern,
+    (rn & 1) ? &refback : NULL);
+}
+static void slowColumn(void) {
+  for(uint8_t j=0; j<rn; j++) {
+    if((rbits >> j) & 1) RGBmatrixPanel_drawPixel(rx, ry + j, rc);
+    else if(rn & 1)      RGBmatrixPanel_drawPixel(rx, ry + j, rb);
+  }
+}
+#ifdef PALETTEBITS
+static uint16_t refentry; // Palette entry 1 as the background had it
+#endif
+static void refPrime(bool after) {
+#ifdef PALETTEBITS
+  if(after) { // Back as it was, for the other side's background
+    RGBmatrixPanel_setPalette(1, refentry);
+    return;
+  }
+  RGBmatrixPanel_drawChar(0, 0, rch, rc, rb, 1, 1);
+  RGBmatrixPanel_setPalette(1, rc ^ rb);
+#else
+  if(!after) RGBmatrixPanel_drawChar(0, 0, rch, rc, rb ^ 0x5555, 1, 1);
+#endif
+}
+static void fastChar(void) {
+  refPrime(false);
+  RGBmatrixPanel_drawChar(rx, ry, rch, rc, rb, rsx, rsy);
+  refPrime(true);
+}
+static void slowChar(void) {
+  uint8_t c = (!_cp437 && (rch >= 176)) ? rch + 1 : rch, line, i, j, a, b;
+
+  refPrime(false);
+  for(i=0; i<6; i++) {
+    line = (i < 5) ? pgm_read_byte(&font[c * 5 + i]) : 0;
+    for(j=0; j<8; j++, line >>= 1) {
+      if(!(line & 1) && (rb == rc)) continue;
+      for(b=0; b<rsy; b++)
+        for(a=0; a<rsx; a++) RGBmatrixPanel_drawPixel(rx + i * rsx + a,
+          ry + j * rsy + b, (line & 1) ? rc : rb);
+    }
+  }
+  refPrime(true);
+}
+static void refChars(void) {
+#ifdef PALETTEBITS
+  refentry = palette[1];
+#endif
+  for(int n=0; n<200; n++) {
+    rx    = refRange(-3, _width + 2);
+    ry    = refRange(-10, _height + 2);
+    rbits = refRand();
+    rn    = refRange(0, 8);
+    rc    = refRand();
+    rb    = (n & 3) ? refRand() : rc; // Some transparent
+    snprintf(refcase, sizeof(refcase), "drawColumnPattern(%d, %d, 0x%02X, "
+      "%d, 0x%04X, 0x%04X)", rx, ry, rbits, rn, rc, rb);
+    refCheck(fastColumn, slowColumn);
+
+    rx  = refRange(-20, _width + 2);
+    ry  = refRange(-26, _height + 2);
+    rch = refRand();
+    rsx = (n & 4) ? refRange(1, 3) : 1;
+    rsy = (n & 4) ? refRange(1, 3) : 1;
+    RGBmatrixPanel_cp437(n & 8);
+    snprintf(refcase, sizeof(refcase), "drawChar(%d, %d, %d, 0x%04X, 0x%04X, "
+      "%d, %d), cp437 %d", rx, ry, rch, rc, rb, rsx, rsy, (n & 8) != 0);
+    refCheck(fastChar, slowChar);
+  }
+  RGBmatrixPanel_cp437(false);
+}
+
+// Custom font glyphs, drawn as runs, against their bitmaps a bit at a
+// time: through drawChar(), and through drawGlyph() cut to a random
+// range of columns, as laid-out text uses it.
+static const GFXfont *reffont;
+static int16_t        rcx0, rcx1;
+static void fastGlyph(void) {
+  RGBmatrixPanel_setFont(reffont);
+  if((rcx0 == 0) && (rcx1 == _width)) {
+    RGBmatrixPanel_drawChar(rx, ry, rch, rc, rb, rsx, rsy);
+  } else {
+    GFXglyph *g = &reffont->glyph[rch - reffont->first];
+    RGBmatrixPanel_drawGlyph(rx + g->xOffset * rsx, ry + g->yOffset * rsy,
+      &reffont->bitmap[g->bitmapOffset], g->width, g->height, rc, rsx, rsy,
+      rcx0, rcx1);
+  }
+  RGBmatrixPanel_setFont(NULL);
+}
+static void slowGlyph(void) {
+  GFXglyph      *g  = &reffont->glyph[rch - reffont->first];
+  const uint8_t *bm = &reffont->bitmap[g->bitmapOffset];
+  int16_t        left = rx + g->xOffset * rsx, top = ry + g->yOffset * rsy, px;
+
+  for(uint16_t i=0; i<g->width * g->height; i++) {
+    if(!(bm[i >> 3] & (0x80 >> (i & 7)))) continue;
+    for(uint8_t b=0; b<rsy; b++) {
+      for(uint8_t a=0; a<rsx; a++) {
+        px = left + (i % g->width) * rsx + a;
+        if((px >= rcx0) && (px < rcx1))
+          RGBmatrixPanel_drawPixel(px, top + (i / g->width) * rsy + b, rc);
+      }
+    }
+  }
+}
+static void refGlyphs(void) {
+  for(int n=0; n<200; n++) {
+    reffont = (n & 1) ? &Picopixel : &FreeSans24pt7b;
+    rch  = refRange(reffont->first, reffont->last);
+    rsx  = (n & 6) ? 1 : refRange(1, 3);
+    rsy  = (n & 6) ? 1 : refRange(1, 3);
+    rx   = refRange(-30, _width + 2);
+    ry   = refRange(-2, _height + 40);
+    rc   = refRand();
+    rb   = refRand(); // Ignored: custom fonts have no background
+    rcx0 = 0;
+    rcx1 = _width;
+    if(n & 8) {
+      rcx0 = refRange(-4, _width);
+      rcx1 = refRange(rcx0, _width + 4);
+    }
+    snprintf(refcase, sizeof(refcase), "%s '%c' at (%d, %d), size %d,%d, "
+      "columns %d-%d", (n & 1) ? "Picopixel" : "FreeSans24pt7b", rch, rx, ry,
+      rsx, rsy, rcx0, rcx1 - 1);
+    refCheck(fastGlyph, slowGlyph);
+  }
+}
+
+// Random text: printable characters, some out of the custom fonts'
+// range, the odd '\r', and sometimes a newline to stop at
+static char reftext[48];
+static void refString(void) {
+  uint8_t n = refRange(1, sizeof(reftext) - 1), i;
+  for(i=0; i<n; i++) {
+    switch(refRand() & 31) {
+     case 0:  reftext[i] = '\r';               break;
+     case 1:  reftext[i] = refRange(128, 255); break;
+     case 2:  reftext[i] = (i > 4) ? '\n' : ' '; break;
+     default: reftext[i] = refRange(' ', '~');
+    }
+  }
+  reftext[i] = 0;
+}
+
+// A line of text's pixels, a bit at a time from the font data, placed
+// as print() would place them, in the current font and size, cut to a
+// box and drawn with drawPixel()
+static void refTextPixels(const char *str, int16_t x, int16_t y,
+  uint16_t color, int16_t bx, int16_t by, int16_t bw, int16_t bh) {
+  uint8_t sx = textsize_x, sy = textsize_y, c, w, h, set;
+  int16_t left, top, px, py;
+
+  for(; (c = *str) && (c != '\n'); str++) {
+    if(c == '\r') continue;
+    GFXglyph *g = NULL;
+    if(!gfxFont) {
+      if(!_cp437 && (c >= 176)) c++;
+      left = x;
+      top  = y;
+      w    = 5;
+      h    = 8;
+      x   += 6 * sx;
+    } else {
+      if((c < gfxFont->first) || (c > gfxFont->last)) continue;
+      g    = &gfxFont->glyph[c - gfxFont->first];
+      left = x + g->xOffset * sx;
+      top  = y + g->yOffset * sy;
+      w    = g->width;
+      h    = g->height;
+      x   += g->xAdvance * sx;
+    }
+    for(uint16_t i=0; i<w * h; i++) {
+      if(g) set = gfxFont->bitmap[g->bitmapOffset + (i >> 3)] & (0x80 >> (i & 7));
+      else  set = (font[c * 5 + i % w] >> (i / w)) & 1;
+      if(!set) continue;
+      for(uint8_t b=0; b<sy; b++) {
+        for(uint8_t a=0; a<sx; a++) {
+          px = left + (i % w) * sx + a;
+          py = top  + (i / w) * sy + b;
+          if((px >= bx) && (px < bx + bw) && (py >= by) && (py < by + bh))
+            RGBmatrixPanel_drawPixel(px, py, color);
+        }
+      }
+    }
+  }
+}
+
+// Opaque text: the box in the background color, then the text cut to
+// it.  Strings are long enough to need more than one pass of glyphs.
+static int16_t rbx, rby, rbw, rbh;
+static void fastOpaque(void) {
+  RGBmatrixPanel_setFont(reffont);
+  RGBmatrixPanel_drawTextOpaque(reftext, rx, ry, rc, rb, rbx, rby, rbw, rbh);
+  RGBmatrixPanel_setFont(NULL);
+}
+static void slowOpaque(void) {
+  RGBmatrixPanel_setFont(reffont);
+  refRect(rbx, rby, rbw, rbh, rb);
+  refTextPixels(reftext, rx, ry, rc, rbx, rby, rbw, rbh);
+  RGBmatrixPanel_setFont(NULL);
+}
+static void refOpaque(void) {
+  static const GFXfont *fonts[] = { NULL, &Picopixel, &FreeSans24pt7b };
+  for(int n=0; n<150; n++) {
+    reffont = fonts[n % 3];
+    refString();
+    RGBmatrixPanel_setTextSize(refRange(1, 2), refRange(1, 2));
+    RGBmatrixPanel_cp437(n & 4);
+    rx  = refRange(-20, _width);
+    ry  = refRange(-4, _height + 20);
+    rc  = refRand();
+    rb  = refRand();
+    rbx = refRange(-4, _width - 2);
+    rby = refRange(-4, _height - 2);
+    rbw = refRange(1, _width + 8);
+    rbh = refRange(1, _height + 8);
+    if(n & 8) { // Box from the text's own bounds
+      uint16_t w, h;
+      RGBmatrixPanel_setFont(reffont);
+      RGBmatrixPanel_setTextWrap(false);
+      RGBmatrixPanel_getTextBounds(reftext, rx, ry, &rbx, &rby, &w, &h);
+      RGBmatrixPanel_setTextWrap(true);
+      RGBmatrixPanel_setFont(NULL);
+      rbw = w;
+      rbh = h;
+    }
+    snprintf(refcase, sizeof(refcase), "drawTextOpaque(\"%.24s\"..., %d, %d, "
+      "box %d,%d %dx%d), font %d", reftext, rx, ry, rbx, rby, rbw, rbh, n % 3);
+    refCheck(fastOpaque, slowOpaque);
+  }
+  RGBmatrixPanel_setTextSize(1);
+  RGBmatrixPanel_cp437(false);
+}
+
+// Laid-out text against print() (transparent), with wrap on and
+// drawn where it was laid out, or with wrap off moved elsewhere.  With
+// a window, columns outside it are put back to the background.
+static RGBmatrixPanel_LaidGlyph  reflaid[sizeof(reftext)];
+static RGBmatrixPanel_TextLayout reflayout;
+static int16_t                   rlx, rly;
+static void fastLayout(void) {
+  RGBmatrixPanel_drawLayout(&reflayout, rlx, rly, rc, rcx0, rcx1 - rcx0);
+}
+static void slowLayout(void) {
+  RGBmatrixPanel_setCursor(rlx, rly);
+  RGBmatrixPanel_setTextColor(rc);
+  RGBmatrixPanel_print(reftext);
+  for(int16_t x=0; x<_width; x++) {
+    if((x >= rcx0) && (x < rcx1)) continue;
+    for(int16_t y=0; y<_height; y++) RGBmatrixPanel_drawPixel(x, y, refColor(x, y));
+  }
+}
+static void refLayouts(void) {
+  static const GFXfont *fonts[] = { NULL, &Picopixel, &FreeSans24pt7b };
+  for(int n=0; n<150; n++) {
+    bool moved = n & 2;
+    refString();
+    if(moved) { // print() starts new lines at column 0, not the origin
+      for(char *p=reftext; *p; p++) if(*p == '\n') *p = ' ';
+    }
+    RGBmatrixPanel_setFont(fonts[n % 3]);
+    RGBmatrixPanel_setTextSize(refRange(1, 2), refRange(1, 2));
+    RGBmatrixPanel_setTextWrap(!moved);
+    RGBmatrixPanel_cp437(n & 4);
+    rx = refRange(-20, _width);
+    ry = refRange(-4, _height + 20);
+    rc = refRand();
+    RGBmatrixPanel_layoutText(&reflayout, reflaid,
+      sizeof(reflaid) / sizeof(reflaid[0]), reftext, rx, ry);
+    rlx  = moved ? refRange(-30, _width) : rx;
+    rly  = moved ? refRange(-4, _height + 20) : ry;
+    rcx0 = -40;
+    rcx1 = 0x7FFF - 40;
+    if(n & 8) {
+      rcx0 = refRange(-4, _width);
+      rcx1 = refRange(rcx0, _width + 4);
+    }
+    snprintf(refcase, sizeof(refcase), "drawLayout(\"%.24s\"..., %d, %d, "
+      "window %d-%d), font %d, wrap %d", reftext, rlx, rly, rcx0, rcx1 - 1,
+      n % 3, !moved);
+    refCheck(fastLayout, slowLayout);
+  }
+  RGBmatrixPanel_setFont(NULL);
+  RGBmatrixPanel_setTextSize(1);
+  RGBmatrixPanel_setTextWrap(true);
+  RGBmatrixPanel_cp437(false);
+}
+
+// Text bounds against the ink print() leaves, drawn to a canvas, which
+// is in raw panel order; classic characters get a background, so their
+// whole cell is inked, as they're measured.  With wrap off (and no
+// newlines), printing is the same anywhere, so text measured off the
+// display is printed moved onto it.  With wrap on it's measured and printed in place, when it
+// all lands on the display.  Text with glyphs not inked to their box
+// edges need only have its ink inside the bounds.  layoutText() must
+// agree with the bounds, and textWidth() with how far print() moves
+// the cursor.
+static void refBoundsFail(const char *what, int16_t x, int16_t y, int16_t w,
+  int16_t h, int16_t x1, int16_t y1, uint16_t bw, uint16_t bh) {
+  if(reffails++ < 10) {
+    fprintf(stderr, "%s, rotation %d: %d,%d %dx%d, bounds %d,%d %ux%u\n",
+      what, RGBmatrixPanel_getRotation(), x, y, w, h, x1, y1, bw, bh);
+  }
+}
+// Whether each glyph of str in the current font is inked to all four
+// edges of its box.  A few aren't (FreeSans24pt7b 'v', 'x' and 'y'
+// leave a blank column), and text with them measures bigger than its
+// ink, its bounds being the glyph boxes'.
+static bool refTight(const char *str) {
+  uint8_t c;
+  for(; gfxFont && (c = *str); str++) {
+    if((c < gfxFont->first) || (c > gfxFont->last)) continue;
+    GFXglyph *g = &gfxFont->glyph[c - gfxFont->first];
+    uint8_t   w = g->width, h = g->height, edges = 0;
+    for(uint16_t i=0; i<w * h; i++) {
+      if(!(gfxFont->bitmap[g->bitmapOffset + (i >> 3)] & (0x80 >> (i & 7))))
+        continue;
+      edges |= ((i % w == 0) ? 1 : 0) | ((i % w == w - 1) ? 2 : 0) |
+               ((i / w == 0) ? 4 : 0) | ((i / w == h - 1) ? 8 : 0);
+    }
+    if(w && h && (edges != 15)) return false;
+  }
+  return true;
+}
+static void refBounds(void) {
+  static const GFXfont *fonts[] = { NULL, &Picopixel, &FreeSans24pt7b };
+  uint16_t *canvas = (uint16_t *)malloc(WIDTH * HEIGHT * 2), bw, bh;
+  int16_t   x1, y1, dx, dy, minx, miny, maxx, maxy, x, y, t;
+
+  for(int n=0; n<300; n++) {
+    bool wrapped = n & 1;
+    refString();
+    if(n & 2) reftext[refRange(0, 3)] = 0; // Short ones, even empty
+    if(!wrapped) { // A newline goes back to column 0, wherever it started
+      for(char *p=reftext; *p; p++) if(*p == '\n') *p = ' ';
+    }
+    RGBmatrixPanel_setFont(fonts[n % 3]);
+    RGBmatrixPanel_setTextSize(refRange(1, 2), refRange(1, 2));
+    RGBmatrixPanel_setTextWrap(wrapped);
+    RGBmatrixPanel_cp437(n & 4);
+    rx = refRange(-60, _width + 30);
+    ry = refRange(-30, _height + 40);
+    RGBmatrixPanel_getTextBounds(reftext, rx, ry, &x1, &y1, &bw, &bh);
+    snprintf(refcase, sizeof(refcase), "getTextBounds(\"%.24s\"..., %d, %d), "
+      "font %d, size %d,%d, wrap %d", reftext, rx, ry, n % 3, textsize_x,
+      textsize_y, wrapped);
+
+    RGBmatrixPanel_layoutText(&reflayout, reflaid,
+      sizeof(reflaid) / sizeof(reflaid[0]), reftext, rx, ry);
+    refcases++;
+    if((reflayout.w != bw) || (reflayout.h != bh) || (bw && bh &&
+       ((reflayout.x1 != x1 - rx) || (reflayout.y1 != y1 - ry)))) {
+      refBoundsFail(refcase, rx + reflayout.x1, ry + reflayout.y1,
+        reflayout.w, reflayout.h, x1, y1, bw, bh);
+    }
+
+    dx = dy = 0;
+    if(bw && bh) {
+      if((bw > _width) || (bh > _height)) continue;
+      if(wrapped) {
+        if((x1 < 0) || (y1 < 0) || (x1 + bw > _width) || (y1 + bh > _height))
+          continue;
+      } else {
+        dx = refRange(0, _width - bw) - x1;
+        dy = refRange(0, _height - bh) - y1;
+      }
+    }
+    memset(canvas, 0, WIDTH * HEIGHT * 2);
+    RGBmatrixPanel_setCanvas(canvas);
+    RGBmatrixPanel_setCursor(rx + dx, ry + dy);
+    RGBmatrixPanel_setTextColor(0xFFFF, 0x0841);
+    RGBmatrixPanel_print(reftext);
+    RGBmatrixPanel_setCanvas(NULL);
+    minx = miny = 0x7FFF;
+    maxx = maxy = -1;
+    for(int16_t i=0; i<WIDTH * HEIGHT; i++) {
+      if(!canvas[i]) continue;
+      x = i % WIDTH;
+      y = i / WIDTH;
+      switch(RGBmatrixPanel_getRotation()) { // Raw back to rotated
+       case 1: t = x; x = y; y = WIDTH - 1 - t;         break;
+       case 2: x = WIDTH - 1 - x; y = HEIGHT - 1 - y;   break;
+       case 3: t = x; x = HEIGHT - 1 - y; y = t;        break;
+      }
+      if(x < minx) minx = x;
+      if(y < miny) miny = y;
+      if(x > maxx) maxx = x;
+      if(y > maxy) maxy = y;
+    }
+    refcases++;
+    if(maxx < 0) { // Nothing inked
+      if(bw && bh) refBoundsFail(refcase, 0, 0, 0, 0, x1, y1, bw, bh);
+    } else if(refTight(reftext) ? ((minx - dx != x1) || (miny - dy != y1) ||
+                (maxx - minx + 1 != bw) || (maxy - miny + 1 != bh)) :
+              ((minx - dx < x1) || (miny - dy < y1) ||
+               (maxx - dx >= x1 + bw) || (maxy - dy >= y1 + bh))) {
+      refBoundsFail(refcase, minx - dx, miny - dy, maxx - minx + 1,
+        maxy - miny + 1, x1, y1, bw, bh);
+    }
+
+    if(!wrapped) {
+      refcases++;
+      if(RGBmatrixPanel_textWidth(reftext) != RGBmatrixPanel_getCursorX() - rx - dx) {
+        snprintf(refcase, sizeof(refcase), "textWidth(\"%.24s\"...) %d, "
+          "print() advanced %d", reftext, RGBmatrixPanel_textWidth(reftext),
+          RGBmatrixPanel_getCursorX() - rx - dx);
+        refBoundsFail(refcase, 0, 0, 0, 0, 0, 0, 0, 0);
+      }
+    }
+  }
+  free(canvas);
+  RGBmatrixPanel_setFont(NULL);
+  RGBmatrixPanel_setTextSize(1);
+  RGBmatrixPanel_setTextWrap(true);
+  RGBmatrixPanel_cp437(false);
+}
+
+// Scrolling, against the background redrawn where it moved to, the
+// uncovered part in the fill color.  In rotation 0, raw rows copied
+// alone too, across and within the halves.
+static void fastScroll(void) { RGBmatrixPanel_scroll(rx, ry, rc); }
+static void slowScroll(void) {
+  for(int16_t y=0; y<_height; y++) {
+    for(int16_t x=0; x<_width; x++) {
+      int16_t sx = x - rx, sy = y - ry;
+      RGBmatrixPanel_drawPixel(x, y, ((sx >= 0) && (sx < _width) &&
+        (sy >= 0) && (sy < _height)) ? refColor(sx, sy) : rc);
+    }
+  }
+}
+#ifndef PALETTEBITS
+static void fastCopyRow(void) { RGBmatrixPanel_copyRow(ry, rh); }
+static void slowCopyRow(void) {
+  for(int16_t x=0; x<WIDTH; x++) RGBmatrixPanel_drawPixel(x, ry, refColor(x, rh));
+}
+#endif
+static void refScrolls(void) {
+  for(int n=0; n<60; n++) {
+    rx = (n & 1) ? refRange(-_width - 2, _width + 2) : refRange(-3, 3);
+    ry = (n & 2) ? refRange(-_height - 2, _height + 2) : refRange(-3, 3);
+    rc = refRand();
+    snprintf(refcase, sizeof(refcase), "scroll(%d, %d, 0x%04X)", rx, ry, rc);
+    refCheck(fastScroll, slowScroll);
+#ifndef PALETTEBITS
+    if(!RGBmatrixPanel_getRotation()) {
+      ry = refRange(0, HEIGHT - 1);
+      rh = refRange(0, HEIGHT - 1);
+      snprintf(refcase, sizeof(refcase), "copyRow(%d, %d)", ry, rh);
+      refCheck(fastCopyRow, slowCopyRow);
+    }
+#endif
+  }
+}
+
+// Layers: a run of frames, each a few random changes (moves, hiding,
+// bitmap, size, areas marked, text) then layersCompose(), which
+// redraws only what changed.  After each, the whole scene drawn afresh
+// with drawPixel() must match; the composited frame is then put back
+// for the next.
+#define REFSPRITES 4
+#define REFSPRITEW 12
+static uint16_t refsprite[REFSPRITES][2][REFSPRITEW * REFSPRITEW];
+static uint8_t  refmask[REFSPRITES][REFSPRITEW * 2];
+static void refScene(const RGBmatrixPanel_Layers *l) {
+  for(int16_t y=0; y<_height; y++) {
+    for(int16_t x=0; x<_width; x++) RGBmatrixPanel_drawPixel(x, y,
+      l->bgbitmap ? l->bgbitmap[y * _width + x] : l->bgcolor);
+  }
+  for(uint8_t i=0; i<l->nsprites; i++) {
+    const RGBmatrixPanel_Sprite *s = &l->sprite[i];
+    if(!s->visible) continue;
+    for(uint16_t j=0; j<s->w * s->h; j++) {
+      uint8_t  a = j % s->w, b = j / s->w;
+      uint16_t c = s->bitmap[j];
+      if(s->mask ? !(s->mask[b * ((s->w + 7) / 8) + a / 8] & (0x80 >> (a & 7)))
+                 : (s->keyed && (c == s->key))) continue;
+      RGBmatrixPanel_drawPixel(s->x + a, s->y + b, c);
+    }
+  }
+  if(l->text) RGBmatrixPanel_drawLayout(l->text, l->textx, l->texty, l->textcolor);
+}
+static void refLayers(void) {
+  RGBmatrixPanel_Sprite     sprites[REFSPRITES];
+  RGBmatrixPanel_Layers     l;
+  RGBmatrixPanel_TextLayout text[2];
+  RGBmatrixPanel_LaidGlyph  laid[2][sizeof(reftext)];
+  int                   n = nRows * ROWBYTES, i, k, f;
+  uint16_t             *bg = (uint16_t *)malloc(WIDTH * HEIGHT * 2);
+
+  for(k=0; k<REFSPRITES; k++) { // Blocks of color, so rows have runs
+    for(i=0; i<REFSPRITEW * REFSPRITEW; i++) {
+      refsprite[k][0][i] = (refRand() & 3) ? (refRand() & 0xF00F) : 0xF81F;
+      refsprite[k][1][i] = refColor(i / 3, k);
+    }
+    for(i=0; i<REFSPRITEW * 2; i++) refmask[k][i] = refRand();
+  }
+  for(i=0; i<WIDTH * HEIGHT; i++) bg[i] = refColor(i % _width / 4, i / _width / 3);
+
+  for(f=0; f<8; f++) {
+    memset(sprites, 0, sizeof(sprites));
+    for(k=0; k<REFSPRITES; k++) {
+      sprites[k].bitmap  = refsprite[k][0];
+      sprites[k].mask    = (k == 1) ? refmask[k] : NULL; // 2 bytes a row
+      sprites[k].key     = 0xF81F;
+      sprites[k].keyed   = (k == 2);
+      sprites[k].visible = true;
+      sprites[k].x       = refRange(-4, _width - 4);
+      sprites[k].y       = refRange(-4, _height - 4);
+      sprites[k].w       = refRange(1, REFSPRITEW);
+      sprites[k].h       = refRange(1, REFSPRITEW);
+    }
+    RGBmatrixPanel_layersInit(&l, sprites, REFSPRITES, refRand(), (f & 1) ? bg : NULL);
+    for(int step=0; step<24; step++) {
+      if(step) {
+        for(int changes=refRange(1, 3); changes--; ) {
+          RGBmatrixPanel_Sprite *s = &sprites[refRange(0, REFSPRITES - 1)];
+          switch(refRange(0, 6)) {
+           case 0: s->x += refRange(-3, 3); s->y += refRange(-3, 3); break;
+           case 1: s->visible = !s->visible;                           break;
+           case 2: s->bitmap = refsprite[s - sprites][refRand() & 1];  break;
+           case 3: s->w = refRange(1, REFSPRITEW);                     break;
+           case 4: s->h = refRange(1, REFSPRITEW);                     break;
+           case 5: // Redrawn as it is
+            RGBmatrixPanel_layersDirty(&l, refRange(-4, _width),
+              refRange(-4, _height), refRange(0, 20), refRange(0, 20));
+            break;
+           default: // Into the layout not in use
+            RGBmatrixPanel_TextLayout *t = &text[l.text == &text[0]];
+            refString();
+            RGBmatrixPanel_layoutText(t, laid[t - text],
+              sizeof(laid[0]) / sizeof(laid[0][0]), reftext, 0, 0);
+            RGBmatrixPanel_layersText(&l, (refRand() & 3) ? t : NULL,
+              refRange(-10, _width), refRange(0, _height + 10), refRand());
+          }
+        }
+      }
+      RGBmatrixPanel_layersCompose(&l);
+      memcpy(refgot, matrixbuff[backindex], n);
+      refScene(&l);
+      for(i=0; (i < n) && !((refgot[i] ^ matrixbuff[backindex][i]) & REFMASK); i++);
+      memcpy(matrixbuff[backindex], refgot, n);
+      refcases++;
+      if((i < n) && (reffails++ < 10)) {
+        fprintf(stderr, "layersCompose(), run %d frame %d, rotation %d: differs "
+          "from drawPixel() at byte %d\n", f, step, RGBmatrixPanel_getRotation(), i);
+      }
+    }
+  }
+  free(bg);
+}
+
+// Canvas: the background and some drawing done in a canvas, then a
+// rectangle of it converted into the back buffer, against the same
+// drawing done in the buffer and, outside the rectangle, the
+// background put back
+static uint16_t *refcanvas;
+static uint8_t   rop;
+static void refCanvasDraw(void) {
+  switch(rop) {
+   case 0:  RGBmatrixPanel_fillRect(rx, ry, rw, rh, rc);                  break;
+   case 1:  RGBmatrixPanel_drawChar(rx, ry, rch, rc, rb, rsx, rsy);       break;
+   case 2:  RGBmatrixPanel_scroll(rw % 5, rh % 5, rc);                    break;
+   default: RGBmatrixPanel_drawLine(rx, ry, rx + rw, ry + rh, rc);
+  }
+}
+static void fastCanvas(void) {
+  RGBmatrixPanel_setCanvas(refcanvas);
+  refBackground();
+  refCanvasDraw();
+  RGBmatrixPanel_setCanvas(NULL);
+  RGBmatrixPanel_convertCanvas(refcanvas, rbx, rby, rbw, rbh);
+}
+static void slowCanvas(void) {
+  refCanvasDraw();
+  for(int16_t y=0; y<_height; y++) {
+    for(int16_t x=0; x<_width; x++) {
+      if((x < rbx) || (x >= rbx + rbw) || (y < rby) || (y >= rby + rbh))
+        RGBmatrixPanel_drawPixel(x, y, refColor(x, y));
+    }
+  }
+}
+static void refCanvas(void) {
+  refcanvas = (uint16_t *)malloc(WIDTH * HEIGHT * 2);
+  for(int n=0; n<100; n++) {
+    rop = n & 3;
+    rx  = refRange(-8, _width + 4);
+    ry  = refRange(-8, _height + 4);
+    rw  = refRange(-4, _width + 8);
+    rh  = refRange(-4, _height + 8);
+    rc  = refRand();
+    rb  = refRand();
+    rch = refRand();
+    rsx = refRange(1, 2);
+    rsy = refRange(1, 2);
+    rbx = 0;
+    rby = 0;
+    rbw = _width;
+    rbh = _height;
+    if(n & 4) {
+      rbx = refRange(-4, _width);
+      rby = refRange(-4, _height);
+      rbw = refRange(0, _width + 4);
+      rbh = refRange(0, _height + 4);
+    }
+    snprintf(refcase, sizeof(refcase), "canvas op %d (%d, %d, %d, %d, 0x%04X), "
+      "convertCanvas(%d, %d, %d, %d)", rop, rx, ry, rw, rh, rc, rbx, rby, rbw, rbh);
+    refCheck(fastCanvas, slowCanvas);
+  }
+  free(refcanvas);
+}
+
+// Compressed images: frames each drawn as the one before plus a few
+// rectangles, coded with codes chosen at random, of random lengths (so
+// they start and end anywhere in a row), then played by imageNext()
+// with copying swaps between, as a sketch would.  Each frame must be
+// as drawn in the back buffer, and after the swap in both buffers:
+// only the rows imageNext() marks dirty are copied over.
+#define REFFRAMES 8
+static int refEncode(const uint8_t *buf, const uint8_t *prev, int len,
+  uint8_t *out) {
+  int i = 0, o = 0, n, same, run, pick;
+
+  while(i < len) {
+    for(same=0; prev && (i + same < len) && (same < 64) &&
+      (buf[i + same] == prev[i + same]); same++);
+    for(run=1; (i + run < len) && (run < 65) && (buf[i + run] == buf[i]); run++);
+    pick = refRand() % 3;
+    if((pick == 0) && same) {          // Unchanged
+      n        = refRange(1, same);
+      out[o++] = 0xC0 | (n - 1);
+    } else if((pick == 1) && (run >= 2)) { // Repeated
+      n        = refRange(2, run);
+      out[o++] = 0x80 | (n - 2);
+      out[o++] = buf[i];
+    } else {                           // Copied
+      n        = refRange(1, (len - i < 128) ? len - i : 128);
+      out[o++] = n - 1;
+      memcpy(&out[o], &buf[i], n);
+      o       += n;
+    }
+    i += n;
+  }
+  return o;
+}
+// Draw REFFRAMES frames, keeping each in drawn[], and code them all as
+// an image into data[] (IMAGEHEADER + REFFRAMES * 2 buffers' room)
+static void refMovie(uint8_t *drawn, uint8_t *data) {
+  int len = nRows * ROWBYTES, total = IMAGEHEADER, f;
+
+  refseed = refRand();
+  refBackground();
+  for(f=0; f<REFFRAMES; f++) {
+    for(int n=refRange(0, 3); f && n--; ) {
+      RGBmatrixPanel_fillRect(refRange(-4, _width), refRange(-4, _height),
+        refRange(1, _width), refRange(1, _height / 2), refRand());
+    }
+    memcpy(&drawn[f * len], matrixbuff[backindex], len);
+    total += refEncode(&drawn[f * len], f ? &drawn[(f - 1) * len] : NULL, len,
+      &data[total]);
+  }
+  data[0] = WIDTH;
+  data[1] = HEIGHT;
+  data[2] = IMAGELAYOUT;
+  data[3] = REFFRAMES;
+  data[4] = 0;
+}
+static void refImages(void) {
+  int                  len = nRows * ROWBYTES, f, i;
+  uint8_t             *drawn = (uint8_t *)malloc(REFFRAMES * len),
+                      *data  = (uint8_t *)malloc(IMAGEHEADER + REFFRAMES * len * 2);
+  RGBmatrixPanel_Image im;
+
+  refMovie(drawn, data);
+
+  // Buffers equal, nothing dirty, as after a copying swap
+  memset(matrixbuff[backindex], 0x55, len);
+  memset(matrixbuff[frontindex], 0x55, len);
+  memset(rowdirty, 0, nRows);
+  RGBmatrixPanel_imageOpen(&im, data);
+  for(i=0; i<REFFRAMES * 2; i++) { // Twice round
+    const char *bad = NULL;
+    f = RGBmatrixPanel_imageNext(&im);
+    if(memcmp(&drawn[f * len], matrixbuff[backindex], len)) bad = "decoded";
+    RGBmatrixPanel_swapBuffers(true);
+    if(!bad && memcmp(&drawn[f * len], matrixbuff[frontindex], len))
+      bad = "shown";
+    if(!bad && memcmp(&drawn[f * len], matrixbuff[backindex], len))
+      bad = "copied back";
+    refcases++;
+    if(bad && (reffails++ < 10))
+      fprintf(stderr, "imageNext(), frame %d: not as drawn when %s\n", f, bad);
+  }
+  free(drawn);
+  free(data);
+}
+
+// All the reference checks, in each rotation; returns failures
+static int refRun(void) {
+  refgot = (uint8_t *)malloc(nRows * ROWBYTES);
+  for(uint8_t r=0; r<4; r++) {
+    RGBmatrixPanel_setRotation(r);
+    refFills();
+    refPixels();
+    refChars();
+    refGlyphs();
+    refOpaque();
+    refLayouts();
+    refBounds();
+    refScrolls();
+    refLayers();
+    refCanvas();
+  }
+  RGBmatrixPanel_setRotation(0);
+  refImages(); // Rotation doesn't apply
+  free(refgot);
+  printf("reference checks: %d cases, %d failed\n",
+    refcases, reffails);
+  return reffails;
+}
+
+// Animation player: frames from a source (drawn by a callback, or the
+// frames of a compressed image, or packed bitmaps of them), put up in
+// step with the refresh.  Swap times are checked for even spacing; the
+// loop() stand-in calls playerUpdate() every 'every' ticks, a callback
+// taking 'work' ticks per frame drawn.  Returns the frames that were
+// late, dropped or unevenly spaced.
+static uint16_t swapat[64];
+static uint8_t  nswaps;
+static uint32_t work;
+static void onSwap(void) {
+  if(nswaps < 64) swapat[nswaps++] = framecount;
+}
+static void drawFrame(uint16_t frame) {
+  RGBmatrixPanel_fillScreen(frame * 0x0841);
+  hostsim_run(work);
+}
+#define PLAYDRAW   0
+#define PLAYIMAGE  1
+#define PLAYPACKED 2
+static int playerRun(uint8_t source, uint8_t fps, uint32_t every,
+  uint32_t drawticks) {
+  static const char * const   name[] = { "draw", "image", "packed" };
+  int                         len = nRows * ROWBYTES, uneven = 0, f;
+  uint8_t                    *drawn = NULL, *data = NULL,
+                             *bitmaps[REFFRAMES];
+  const uint8_t              *table[REFFRAMES];
+  RGBmatrixPanel_Image        im;
+  RGBmatrixPanel_Player       pl;
+
+  memset(&pl, 0, sizeof(pl));
+  if(source == PLAYDRAW) {
+    pl.draw   = drawFrame;
+    pl.frames = 10;
+  } else {
+    drawn = (uint8_t *)malloc(REFFRAMES * len);
+    data  = (uint8_t *)malloc(IMAGEHEADER + REFFRAMES * len * 2);
+    refMovie(drawn, data);
+    if(source == PLAYIMAGE) {
+      RGBmatrixPanel_imageOpen(&im, data);
+      pl.image = &im;
+    } else {
+      for(f=0; f<REFFRAMES; f++) {
+        table[f] = bitmaps[f] = (uint8_t *)malloc(PACKEDHEADER + len);
+        bitmaps[f][0] = WIDTH;
+        bitmaps[f][1] = HEIGHT;
+        bitmaps[f][2] = IMAGELAYOUT;
+        memcpy(&bitmaps[f][PACKEDHEADER], &drawn[f * len], len);
+      }
+      pl.packed = table;
+      pl.frames = REFFRAMES;
+    }
+  }
+  work      = drawticks;
+  nswaps    = 0;
+  RGBmatrixPanel_setSwapCallback(onSwap);
+  RGBmatrixPanel_playerInit(&pl, fps);
+  while(nswaps < 40) {
+    RGBmatrixPanel_playerUpdate(&pl);
+    hostsim_run(every);
+  }
+  RGBmatrixPanel_setSwapCallback(NULL);
+  for(int i=1; i<nswaps; i++) uneven += ((uint16_t)(swapat[i] - swapat[i-1]) != pl.period);
+  printf("player %-6s %2d fps, loop every %6u ticks, draw %6u: %d "
+    "refreshes/frame, %d shown, %d late, %d dropped, %d uneven\n",
+    name[source], fps, every, drawticks, pl.period, pl.shown, pl.late,
+    pl.dropped, uneven);
+  if(source == PLAYPACKED)
+    for(f=0; f<REFFRAMES; f++) free(bitmaps[f]);
+  free(drawn);
+  free(data);
+  return pl.late + pl.dropped + uneven;
+}
+
+int main(int argc, char *argv[]) {
+  const char *geom = (argc > 1) ? argv[1] : "32x32";
+  const char *out  = (argc > 2) ? argv[2] : NULL;
+  int         errors = 0, h = 0, w = 0;
+  char        scan = 0, label[32];
+
+  sscanf(geom, "%dx%d%c", &h, &w, &scan);
+  if((!((h == 16) && (w == 32)) && !((h == 32) && ((w == 32) || (w == 64)))) ||
+     (scan && (scan != 'i'))) {
+    fprintf(stderr, "Usage: %s [16x32|32x32|32x64][i] [out.ppm]\n", argv[0]);
+    return 1;
+  }
+#ifdef MATRIX_WIDTH
+  if((w != WIDTH) || (h != HEIGHT)) {
+    fprintf(stderr, "%s: built for %dx%d panels only\n", argv[0], HEIGHT, WIDTH);
+    return 1;
+  }
+#endif
+  RGBmatrixPanel_Adafruit_GFX(w, h);
+  RGBmatrixPanel_init(h / 2, true, w);
+  RGBmatrixPanel_begin(scan == 'i');
+
+  uint8_t levels = (1 << nPlanes) - 1,
+          *shown = (uint8_t *)malloc(WIDTH * HEIGHT * 3),
+          *want  = (uint8_t *)malloc(WIDTH * HEIGHT * 3);
+
+  scene();
+  RGBmatrixPanel_swapBuffers(true);
+#ifdef PALETTEBITS
+  decodePalette(matrixbuff[frontindex], want);
+#else
+  hostsim_decodeBuffer(matrixbuff[frontindex], WIDTH, nRows, nPlanes, want);
+#endif
+  snprintf(label, sizeof(label), "%s panel", geom);
+  errors += sampleFrames(shown, want, label);
+#ifndef PALETTEBITS
+  // Switched mid-frame, both ways, in frames that are checked
+  errors += sampleFrames(shown, want, "  via row source", true, unpackRow);
+  errors += sampleFrames(shown, want, "  and back", true, NULL);
+#endif
+
+  // Refresh health over a second of display time
+  RGBmatrixPanel_Stats st;
+  RGBmatrixPanel_stats(&st);
+  hostsim_run(F_CPU);
+  RGBmatrixPanel_stats(&st);
+#if ISRSTATS
+  printf("stats: %u refreshes, interrupt worst %u ticks, average %u, "
+    "latency %u, %u overruns, load %u%%\n", st.refreshes, st.worst,
+    st.average, st.latency, st.overruns, st.load);
+#else
+  printf("stats: %u refreshes (interrupt timing: build with -DISRSTATS=1)\n",
+    st.refreshes);
+#endif
+
+  // Incremental update: one changed pixel, then a copying swap
+  RGBmatrixPanel_drawPixel(0, 0, 0x1234);
+  RGBmatrixPanel_swapBuffers(true);
+  printf("swapBuffers(true) after 1 pixel: %u of %d bytes not copied\n",
+    RGBmatrixPanel_swapSaved(), nRows * ROWBYTES);
+
+  if(out) {
+    FILE *fp = fopen(out, "wb");
+    if(!fp) {
+      perror(out);
+      return 1;
+    }
+    fprintf(fp, "P6\n%d %d\n%d\n", WIDTH, HEIGHT, levels);
+    fwrite(shown, 3, WIDTH * HEIGHT, fp);
+    fclose(fp);
+  }
+
+  errors += refRun();
+
+  printf("drawPixel x%d  %10.0f ns\n", WIDTH * HEIGHT, bench(benchPixels, 100));
+  printf("fillRect         %10.0f ns\n", bench(benchFillRect, 100));
+  printf("fillScreen       %10.0f ns\n", bench(benchFillScreen, 100));
+  printf("drawFastHLine    %10.0f ns\n", bench(benchHLine, 1000));
+  printf("drawFastVLine    %10.0f ns\n", bench(benchVLine, 1000));
+  printf("drawLine         %10.0f ns\n", bench(benchLine, 1000));
+  printf("fillCircle       %10.0f ns\n", bench(benchCircle, 100));
+  printf("print 5 chars    %10.0f ns\n", bench(benchText, 1000));
+  printf("  with bg color  %10.0f ns\n", bench(benchTextBg, 1000));
+  printf("  FreeSans24pt   %10.0f ns\n", bench(benchFontText, 1000));
+  printf("  opaque, box    %10.0f ns\n", bench(benchTextOpaque, 1000));
+  RGBmatrixPanel_setTextWrap(false);
+  RGBmatrixPanel_layoutText(&marqueelayout, marqueeglyphs,
+    sizeof(marqueeglyphs) / sizeof(marqueeglyphs[0]), marquee, 0, 0);
+  RGBmatrixPanel_setTextWrap(true);
+  printf("marquee, print   %10.0f ns\n", bench(benchMarqueePrint, 1000));
+  printf("  laid out       %10.0f ns\n", bench(benchMarqueeLayout, 1000));
+  printf("scroll 1 left    %10.0f ns\n", bench(benchScrollH, 1000));
+  printf("scroll 1 up      %10.0f ns\n", bench(benchScrollV, 1000));
+  for(int i=0; i<8 * 8; i++) ballbitmap[i] = (i % 9) ? 0xF800 : 0;
+  memset(&ball, 0, sizeof(ball));
+  ball.bitmap  = ballbitmap;
+  ball.w       = ball.h = 8;
+  ball.keyed   = ball.visible = true;
+  RGBmatrixPanel_layersInit(&layers, &ball, 1, 0x0010, NULL);
+  RGBmatrixPanel_layersCompose(&layers);
+  printf("layers, 1 sprite %10.0f ns\n", bench(benchSprite, 1000));
+  printf("canvas drawPixel %10.0f ns\n", bench(benchCanvasPixels, 100));
+  // Convert a picture, not the one color drawn above: every pixel its own
+  for(int i=0; i<WIDTH * HEIGHT; i++) canvas[i] = refColor(i % WIDTH, i / WIDTH);
+  printf("convertCanvas    %10.0f ns\n", bench(benchConvert, 100));
+  printf("drawRGBBitmap    %10.0f ns\n", bench(benchRGBBitmap, 100));
+  // The frame buffer is a full screen packed bitmap already
+  packed[0] = WIDTH;
+  packed[1] = HEIGHT;
+  packed[2] = IMAGELAYOUT;
+  memcpy(&packed[PACKEDHEADER], matrixbuff[backindex], nRows * ROWBYTES);
+  printf("drawPacked       %10.0f ns\n", bench(benchPacked, 1000));
+  printf("  at x=16        %10.0f ns\n", bench(benchPackedPart, 1000));
+  printf("refresh rate     %10u Hz (estimated)\n", RGBmatrixPanel_refreshRate());
+  // Keeping up, from each source, frames must all be on time
+  for(uint8_t src=PLAYDRAW; src<=PLAYPACKED; src++) {
+    if(playerRun(src, 30, 1000, (src == PLAYDRAW) ? 20000 : 0)) {
+      fprintf(stderr, "player doesn't keep time when it can\n");
+      errors++;
+    }
+  }
+  playerRun(PLAYDRAW, 30, 1000, F_CPU / 25);   // Draws too slowly
+  playerRun(PLAYDRAW, 60, F_CPU / 20, 20000);  // Loop too slow
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+// THIS IS NOT ARDUINO CODE -- DON'T INCLUDE IN YOUR SKETCH.  It's a
+// command-line stand-in for a panel streamed to over a serial line: the
+// library runs as a sketch calling RGBmatrixPanel_serialPoll() from
+// loop() would, on the host simulator (hostsim.h), with its UART on a
+// pty.  The pty's name is printed; point extras/matrixsend.cpp at it.
+// Each frame swapped in is checked on the virtual panel against the
+// frame buffer, and what the panel showed is written to a PPM image
+// (overwritten each frame).  Exit status is nonzero if they disagreed.
+//
+//   g++ -O2 -DRGBMATRIX_HOST serialsim.cpp -o serialsim
+//   ./serialsim [16x32|32x32|32x64][i] [frames [out.ppm]]
+//
+// It stops after that many frames, or with frames 0 (the default) when
+// killed.  Bytes come in no faster than 115200 baud would let them, in
+// simulated time; while none are coming, that keeps roughly to real
+// time.  Build with the same -DnPlanes (or -DPALETTEBITS) as
+// matrixsend; in palette mode the panel isn't checked.  For the protocol
+// itself, broken packets included, see extras/serialtest.cpp.
+
+#include "../RGBmatrixPanel.cpp"
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+
+#define BAUD 115200
+
+// Called after every interrupt; the one after a frame's first data was
+// loaded latches it, and starts the frame on the panel.
+#define SAMPLEFRAMES 4
+static int      frames;
+static bool     armed;
+static uint8_t *sample;
+
+static void onISR(void) {
+  bool start = armed;
+  armed = (plane == 0) && ((scaninterleave ? scanblock : row) == 0);
+  if(start) {
+    if(frames == 1) hostsim_panelReset();
+    if(frames == 1 + SAMPLEFRAMES)
+      hostsim_panelImage(WIDTH, HEIGHT, (1 << nPlanes) - 1, sample);
+    frames++;
+  }
+}
+
+// Show the front buffer for a few frames, into shown[]
+static void sampleFrames(uint8_t *shown) {
+  frames          = 0;
+  armed           = false;
+  sample          = shown;
+  hostsim_isrhook = onISR;
+  while(frames <= 1 + SAMPLEFRAMES) hostsim_run(F_CPU / 1000);
+  hostsim_isrhook = NULL;
+}
+
+// A pty for the UART, raw, with its far end held open so there's no
+// hangup between senders.  Returns the near end, or -1.
+static int openPty(void) {
+  struct termios t;
+  int            fd = posix_openpt(O_RDWR | O_NOCTTY), far;
+
+  if((fd < 0) || grantpt(fd) || unlockpt(fd) ||
+     ((far = open(ptsname(fd), O_RDWR | O_NOCTTY)) < 0)) {
+    perror("pty");
+    return -1;
+  }
+  tcgetattr(far, &t);
+  cfmakeraw(&t);
+  tcsetattr(far, TCSANOW, &t);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+int main(int argc, char *argv[]) {
+  const char *geom  = (argc > 1) ? argv[1] : "32x32";
+  int         count = (argc > 2) ? atoi(argv[2]) : 0;
+  const char *out   = (argc > 3) ? argv[3] : NULL;
+  int         errors = 0, got = 0, h = 0, w = 0, bad;
+  char        scan = 0;
+
+  sscanf(geom, "%dx%d%c", &h, &w, &scan);
+  if((!((h == 16) && (w == 32)) && !((h == 32) && ((w == 32) || (w == 64)))) ||
+     (scan && (scan != 'i')) || (count < 0)) {
+    fprintf(stderr, "Usage: %s [16x32|32x32|32x64][i] [frames [out.ppm]]\n",
+      argv[0]);
+    return 1;
+  }
+#ifdef MATRIX_WIDTH
+  if((w != WIDTH) || (h != HEIGHT)) {
+    fprintf(stderr, "%s: built for %dx%d panels only\n", argv[0], HEIGHT, WIDTH);
+    return 1;
+  }
+#endif
+  RGBmatrixPanel_Adafruit_GFX(w, h);
+  RGBmatrixPanel_init(h / 2, true, w);
+  RGBmatrixPanel_begin(scan == 'i');
+  RGBmatrixPanel_serialBegin(BAUD);
+  if((hostsim_uartfd = openPty()) < 0) return 1;
+  printf("%s\n", ptsname(hostsim_uartfd));
+  fflush(stdout);
+
+  uint8_t levels = (1 << nPlanes) - 1,
+          *shown = (uint8_t *)malloc(WIDTH * HEIGHT * 3),
+          *want  = (uint8_t *)malloc(WIDTH * HEIGHT * 3);
+
+  while(!count || (got < count)) {
+    if(RGBmatrixPanel_serialPoll()) {
+      got++;
+      sampleFrames(shown);
+      bad = 0;
+#ifndef PALETTEBITS
+      hostsim_decodeBuffer(matrixbuff[frontindex], WIDTH, nRows, nPlanes, want);
+      for(int i=0; i<WIDTH * HEIGHT * 3; i++) bad += (shown[i] != want[i]);
+#endif
+      printf("frame %d: %d mismatched channels\n", got, bad);
+      errors += bad;
+      if(out) {
+        FILE *fp = fopen(out, "wb");
+        if(fp) {
+          fprintf(fp, "P6 %d %d %d\n", WIDTH, HEIGHT, levels);
+          fwrite(shown, 3, WIDTH * HEIGHT, fp);
+          fclose(fp);
+        }
+      }
+      fflush(stdout);
+    }
+    if((hostsim_uartbyte < 0) && !(UCSRA & _BV(RXC))) {
+      // Nothing in yet: keep roughly in step with real time meanwhile
+      struct pollfd p = { hostsim_uartfd, POLLIN, 0 };
+      if(!poll(&p, 1, 1)) hostsim_run(F_CPU / 1000);
+    }
+    hostsim_run(hostsim_uartTicks());
+  }
+
+  free(shown);
+  free(want);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,268 @@
+// THIS IS NOT ARDUINO CODE -- DON'T INCLUDE IN YOUR SKETCH.  It's a
+// command-line test of serial frame streaming (RGBmatrixPanel_serialPoll())
+// on the host simulator (hostsim.h), needing nothing else: packets, good
+// and broken, go down a socket pair into the simulated UART a byte at a
+// time, at the line's rate, while the library polls as loop() would.
+// Each reply is checked against what the protocol says it should be, and
+// the frame buffer (and rowdirty) against the data sent.
+//
+//   g++ -O2 -DRGBMATRIX_HOST serialtest.cpp -o serialtest
+//   ./serialtest [16x32|32x32|32x64][i]
+//
+// Exit status is nonzero if anything didn't check out.  Any -DnPlanes or
+// -DPALETTEBITS build works.
+
+#include "../RGBmatrixPanel.cpp"
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#define BAUD      115200
+#define LINES     (nRows * PACKLINES) // Lines of the buffer, as packets see it
+#define LINEBYTES (WIDTH / PACKCOLS)  // ...and bytes of each
+
+static int      far;    // Sender's end of the UART's line
+static int      errors, swaps;
+static uint8_t *model;  // What the back buffer should hold
+
+// Let the sketch poll for n bytes' time
+static void pollFor(uint32_t n) {
+  while(n--) {
+    if(RGBmatrixPanel_serialPoll()) swaps++;
+    hostsim_run(hostsim_uartTicks());
+  }
+}
+
+// Send n bytes down the line; the one at index bad (if any) comes in
+// with line error bits err
+static void sendBytes(const uint8_t *p, int n, int bad = -1, uint8_t err = 0) {
+  for(int i=0; i<n; i++) {
+    if(i == bad) hostsim_uarterror = err;
+    if(write(far, &p[i], 1) != 1) perror("write");
+    pollFor(1);
+  }
+}
+
+// Build a packet into p, with random data; returns its length
+static int packet(uint8_t *p, uint8_t flags, uint8_t line, uint8_t lines,
+  uint8_t col, uint8_t cols) {
+  int     i, n = lines * cols;
+  uint8_t s1, s2;
+
+  p[0] = SERIALSYNC;
+  p[1] = flags;
+  p[2] = line;
+  p[3] = lines;
+  p[4] = col;
+  p[5] = cols;
+  p[6] = flags + line + lines + col + cols;
+  if(!n) return SERIALHEADER;
+  for(s1=s2=i=0; i<n; i++) s2 += (s1 += (p[SERIALHEADER + i] = rand()));
+  p[SERIALHEADER + n]     = s1;
+  p[SERIALHEADER + n + 1] = s2;
+  return SERIALHEADER + n + 2;
+}
+
+// Packet p's data, as the buffer should now hold it
+static void apply(const uint8_t *p) {
+  for(int i=0; i<p[3]; i++)
+    memcpy(&model[(p[2] + i) * LINEBYTES + p[4]],
+      &p[SERIALHEADER + i * p[5]], p[5]);
+}
+
+// Give the sketch time to answer -- a swap waits for the end of a
+// refresh, at 8 planes up to 1/5 second -- then check the reply is
+// exactly want[].  No answer is waited 50 ms for.
+static void expectReply(const char *what, const uint8_t *want, int n) {
+  uint8_t got[16];
+  int     len = 0, t, r;
+
+  for(t=0; (t < 50) || ((len < n) && (t < 2000)); t++) { // 1 ms steps
+    pollFor(F_CPU / 1000 / hostsim_uartTicks());
+    if((r = read(far, &got[len], sizeof(got) - len)) > 0) len += r;
+  }
+  if((len != n) || (n && memcmp(got, want, n))) {
+    printf("%s: replied", what);
+    for(int i=0; i<len; i++) printf(" %02X", got[i]);
+    printf(len ? ", not" : " nothing, not");
+    for(int i=0; i<n; i++) printf(" %02X", want[i]);
+    printf("\n");
+    errors++;
+  }
+}
+
+static void expectAck(const char *what, uint8_t c = SERIALACK) {
+  expectReply(what, &c, 1);
+}
+
+// Buffer buf must match the model
+static void expectBuffer(const char *what, const uint8_t *buf) {
+  for(int i=0; i<LINES * LINEBYTES; i++) {
+    if(buf[i] != model[i]) {
+      printf("%s: line %d byte %d is %02X, not %02X\n", what,
+        i / LINEBYTES, i % LINEBYTES, buf[i], model[i]);
+      errors++;
+      return;
+    }
+  }
+}
+
+// rowdirty[] must be set for the rows of lines [line, line + lines)
+// and no others
+static void expectDirty(const char *what, int line, int lines) {
+  for(int r=0; r<nRows; r++) {
+    bool want = lines && (r >= line / PACKLINES) &&
+                (r <= (line + lines - 1) / PACKLINES);
+    if(!rowdirty[r] != !want) {
+      printf("%s: rowdirty[%d] is %d\n", what, r, rowdirty[r]);
+      errors++;
+      return;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *geom = (argc > 1) ? argv[1] : "32x32";
+  int         h = 0, w = 0, n, fds[2], i;
+  char        scan = 0;
+
+  sscanf(geom, "%dx%d%c", &h, &w, &scan);
+  if((!((h == 16) && (w == 32)) && !((h == 32) && ((w == 32) || (w == 64)))) ||
+     (scan && (scan != 'i'))) {
+    fprintf(stderr, "Usage: %s [16x32|32x32|32x64][i]\n", argv[0]);
+    return 1;
+  }
+#ifdef MATRIX_WIDTH
+  if((w != WIDTH) || (h != HEIGHT)) {
+    fprintf(stderr, "%s: built for %dx%d panels only\n", argv[0], HEIGHT, WIDTH);
+    return 1;
+  }
+#endif
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+    perror("socketpair");
+    return 1;
+  }
+  hostsim_uartfd = fds[0];
+  far            = fds[1];
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+  srand(1);
+
+  RGBmatrixPanel_Adafruit_GFX(w, h);
+  RGBmatrixPanel_init(h / 2, true, w);
+  RGBmatrixPanel_begin(scan == 'i');
+  RGBmatrixPanel_serialBegin(BAUD);
+
+  uint8_t *p    = (uint8_t *)malloc(SERIALHEADER + LINES * LINEBYTES + 2),
+          *back = matrixbuff[backindex];
+  model = (uint8_t *)malloc(LINES * LINEBYTES);
+  memcpy(model, back, LINES * LINEBYTES);
+
+  // Query: the panel's size and layout, and nothing written
+  uint8_t query[] = { SERIALACK, (uint8_t)WIDTH, (uint8_t)HEIGHT,
+                     (uint8_t)IMAGELAYOUT };
+  memset(rowdirty, 0, nRows);
+  sendBytes(p, packet(p, SERIALQUERY, 0, 0, 0, 0));
+  expectReply("query", query, sizeof(query));
+  expectDirty("query", 0, 0);
+
+  // Rectangles, whole lines and single bytes among them: the data lands
+  // there, and only their rows are marked dirty
+  for(i=0; i<40; i++) {
+    int line  = (i & 1) ? 0 : rand() % LINES,
+        lines = (i & 2) ? 1 : 1 + rand() % (LINES - line),
+        col   = (i & 4) ? 0 : rand() % LINEBYTES,
+        cols  = (i & 8) ? LINEBYTES - col : 1 + rand() % (LINEBYTES - col);
+    memset(rowdirty, 0, nRows);
+    sendBytes(p, n = packet(p, 0, line, lines, col, cols));
+    apply(p);
+    expectAck("rectangle");
+    expectBuffer("rectangle", back);
+    expectDirty("rectangle", line, lines);
+  }
+
+  // A broken header is refused before anything's written
+  memset(rowdirty, 0, nRows);
+  n = packet(p, 0, 1, LINES / 2, 1, LINEBYTES / 2);
+  p[6]++;
+  sendBytes(p, n);
+  expectAck("header check", SERIALNAK);
+  p[6]--;
+  p[3] = LINES; // Runs off the bottom
+  p[6] += LINES - LINES / 2;
+  sendBytes(p, n);
+  expectAck("rectangle off the buffer", SERIALNAK);
+  sendBytes(p, n = packet(p, 0, 0, 1, LINEBYTES / 2, LINEBYTES / 2 + 1));
+  expectAck("rectangle off the line", SERIALNAK);
+  // The rest of a refused packet goes unread, even a whole good packet
+  // in its data: it's answered once, and nothing's written
+  uint8_t inner[SERIALHEADER + 1 + 2];
+  n = packet(p, 0, 1, LINES / 2, 1, LINEBYTES / 2);
+  memcpy(&p[SERIALHEADER + 3], inner, packet(inner, SERIALSWAP, 0, 1, 0, 1));
+  p[6]++;
+  sendBytes(p, n);
+  expectAck("packet in a refused one's data", SERIALNAK);
+  n = packet(p, 0, 1, LINES / 2, 1, LINEBYTES / 2);
+  sendBytes(p, n, 3, _BV(FE));
+  expectAck("framing error in the header", SERIALNAK);
+  sendBytes(p, n, 5, _BV(DOR));
+  expectAck("overrun in the header", SERIALNAK);
+  expectBuffer("refused header", back);
+  expectDirty("refused header", 0, 0);
+
+  // Broken data is refused (though written), and then sent again
+  apply(p);
+  p[n - 2]++;
+  sendBytes(p, n);
+  expectAck("data check 1", SERIALNAK);
+  p[n - 2]--;
+  p[n - 1]++;
+  sendBytes(p, n);
+  expectAck("data check 2", SERIALNAK);
+  p[n - 1]--;
+  sendBytes(p, n, SERIALHEADER + 2, _BV(FE));
+  expectAck("framing error in the data", SERIALNAK);
+  sendBytes(p, n, n - 1, _BV(FE));
+  expectAck("framing error in the data check", SERIALNAK);
+  sendBytes(p, n);
+  expectAck("data sent again");
+  expectBuffer("data sent again", back);
+
+  // A packet that stalls part way is dropped after a quarter second (or
+  // a couple of refreshes, when they're slower), unanswered, and the
+  // next one taken whole
+  n = packet(p, 0, 0, LINES, 0, LINEBYTES);
+  sendBytes(p, n / 2);
+  pollFor((serialtimeout + 2) * (F_CPU / hostsim_uartTicks()) /
+    RGBmatrixPanel_refreshRate());
+  expectReply("stalled packet", NULL, 0);
+  sendBytes(p, n);
+  apply(p);
+  expectAck("after a stalled packet");
+  expectBuffer("after a stalled packet", back);
+
+  // Swaps: a whole frame is answered once it's on show; a part of one
+  // copied back, so the back buffer keeps up too; and a swap alone
+  swaps = 0;
+  sendBytes(p, packet(p, SERIALSWAP, 0, LINES, 0, LINEBYTES));
+  apply(p);
+  expectAck("frame");
+  expectBuffer("frame", matrixbuff[frontindex]);
+  memcpy(model, matrixbuff[backindex], LINES * LINEBYTES);
+  sendBytes(p, packet(p, SERIALSWAP | SERIALCOPY, 1, 2, 1, 2));
+  apply(p);
+  expectAck("copied frame");
+  expectBuffer("copied frame (front)", matrixbuff[frontindex]);
+  expectBuffer("copied frame (back)", matrixbuff[backindex]);
+  sendBytes(p, packet(p, SERIALSWAP | SERIALCOPY, 0, 0, 0, 0));
+  expectAck("swap alone");
+  expectBuffer("swap alone", matrixbuff[frontindex]);
+  if(swaps != 3) {
+    printf("serialPoll() reported %d swaps, not 3\n", swaps);
+    errors++;
+  }
+
+  printf("serial checks: %d failed\n", errors);
+  free(p);
+  free(model);
+  return errors ? 1 : 0;
+}
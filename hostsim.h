@@ -0,0 +1,391 @@
+/*
+Host (PC) stand-in for the parts of avr-libc that RGBmatrixPanel uses.
+Selected from config.h by building with -DRGBMATRIX_HOST; see
+extras/panelsim.cpp for a command-line driver.
+
+- PORTB/PORTD are small objects rather than plain bytes, so every write
+  is seen by a virtual HUB75 panel: CLK rising edges shift DATAPORT into
+  a column shift register, LAT rising edges move it to the output
+  latches, and while OE is low the latched columns of the addressed row
+  pair accumulate on-time.  Dividing each LED's on-time by its row's
+  total lit time gives back the BCM brightness that was displayed.
+  The longest any row then goes unlit is kept too (darkmax): the gap a
+  camera or a moving eye sees as flicker.
+
+- Timer1 is advanced by hostsim_run() (and by _delay_ms(), so the
+  swapBuffers() busy-wait works unchanged).  On overflow of ICR1 the
+  TIMER1_OVF_vect handler is called, exactly as on the chip, after a
+  fixed interrupt entry latency.  Code inside the handler takes no
+  simulated time.
+
+- The UART reads and writes a file descriptor (hostsim_uartfd, e.g. a
+  pty; see extras/serialsim.cpp), a byte at a time.  Received bytes are
+  let through no faster than the baud rate set in UBRR allows, in
+  simulated time.  A line error (FE or DOR) can be put on the next byte
+  read with hostsim_uarterror; see extras/serialtest.cpp.
+
+Only what the library touches is modelled; this is not an AVR emulator.
+*/
+
+#ifndef HOSTSIM_H
+#define HOSTSIM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROGMEM
+#define memcpy_P memcpy
+#define pgm_read_pointer(addr) (*(void * const *)(addr))
+#define _BV(bit) (1 << (bit))
+
+// Timer1 register bits, ATmega8 numbering
+#define CS10  0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 2
+#define TOV1  2
+
+// UART register bits, ATmega8 numbering
+#define RXC   7
+#define UDRE  5
+#define FE    4
+#define DOR   3
+#define U2X   1
+#define RXEN  4
+#define TXEN  3
+
+#define ISR_BLOCK
+#define ISR(vector, ...) void vector(void)
+#define TIMER1_OVF_vect  hostsim_timer1_ovf
+
+#define HOSTSIM_MAXWIDTH 64 // Longest column shift register modelled
+#define HOSTSIM_MAXROWS  16 // Multiplexed rows (address lines A-D)
+#define HOSTSIM_LATENCY  56 // Ticks from overflow to handler, as measured
+
+// The interrupt code notes the AVR cycles each of its paths costs;
+// hostsim_isrticks totals them for the current handler call and
+// hostsim_isrhook, if set, is called after each one.
+#define ISRTICKS(n) (hostsim_isrticks += (n))
+
+// A busy-wait inside the handler: the one place it takes simulated time.
+#define __builtin_avr_delay_cycles(n) hostsim_delayCycles(n)
+
+void hostsim_portWrite(void);
+void hostsim_timer1_ovf(void);
+
+// An I/O port register; any store is reported to the virtual panel.
+struct HostPort {
+  volatile uint8_t value;
+  HostPort &operator=(uint8_t n) {
+    value = n;
+    hostsim_portWrite();
+    return *this;
+  }
+  // int, as the AVR idiom PORT &= ~(1 << PIN) gives, so it's no warning
+  HostPort &operator|=(int n) { return *this = (uint8_t)(value | n); }
+  HostPort &operator&=(int n) { return *this = (uint8_t)(value & n); }
+  operator uint8_t() const { return value; }
+};
+
+bool     hostsim_ienable; // Global interrupt enable (SREG I bit)
+bool     hostsim_inisr;   // Running the Timer1 overflow handler
+uint64_t hostsim_now;     // Simulated CPU ticks since start
+uint32_t hostsim_isrticks;
+void   (*hostsim_isrhook)(void);
+
+volatile uint8_t  DDRB, DDRD, TCCR1A, TCCR1B, TIMSK, TIFR;
+volatile uint16_t ICR1;
+
+// Timer1's counter.  Handler code takes no simulated time, but read
+// from inside the handler the counter has run on by the ticks its
+// ISRTICKS() notes counted since the counter was last set, as it would
+// on the chip, so the handler can time itself -- wrapping after ICR1
+// and setting TOV1 as it passes it.
+struct HostCounter {
+  volatile uint16_t value;
+  uint32_t          mark; // hostsim_isrticks when last set
+  HostCounter &operator=(uint16_t n) {
+    value = n;
+    mark  = hostsim_isrticks;
+    return *this;
+  }
+  HostCounter &operator+=(uint32_t n) {
+    value += n;
+    return *this;
+  }
+  operator uint16_t() const {
+    uint32_t n = value;
+    if(hostsim_inisr) {
+      n += hostsim_isrticks - mark;
+      if(n > ICR1) {
+        TIFR |= _BV(TOV1);
+        n    %= (uint32_t)ICR1 + 1;
+      }
+    }
+    return n;
+  }
+};
+
+HostPort          PORTB, PORTD;
+HostCounter       TCNT1;
+
+int      hostsim_uartfd = -1; // Stands in for the UART's line
+int16_t  hostsim_uartbyte = -1; // Read from it, not yet taken from UDR
+uint64_t hostsim_uartnext;    // No byte comes in before this tick
+uint8_t  hostsim_uarterror;   // FE/DOR bits the next byte read comes with
+uint8_t  hostsim_uartstatus;  // ...and those of hostsim_uartbyte
+
+volatile uint8_t UCSRB, UBRRH, UBRRL;
+
+// Ticks one byte (start, 8 data and stop bits) takes at the set baud
+uint32_t hostsim_uartTicks(void);
+
+// UART status: RXC once a byte is in and its time has come, with any
+// line error it came with, UDRE always (a write goes straight out).
+// Only U2X is kept of what's stored.
+struct HostUartStatus {
+  uint8_t value;
+  HostUartStatus &operator=(uint8_t n) {
+    value = n & _BV(U2X);
+    return *this;
+  }
+  operator uint8_t() {
+    uint8_t c;
+    if((hostsim_uartbyte < 0) && (hostsim_uartfd >= 0) &&
+       (read(hostsim_uartfd, &c, 1) == 1)) {
+      hostsim_uartbyte   = c;
+      hostsim_uartstatus = hostsim_uarterror;
+      hostsim_uarterror  = 0;
+    }
+    return value | _BV(UDRE) | (((hostsim_uartbyte >= 0) &&
+      (hostsim_now >= hostsim_uartnext)) ? _BV(RXC) | hostsim_uartstatus : 0);
+  }
+};
+
+// UART data: reading takes the byte in (RXC clears until the next has
+// had time to arrive), writing sends one.
+struct HostUartData {
+  HostUartData &operator=(uint8_t c) {
+    if(hostsim_uartfd >= 0) {
+      ssize_t n = write(hostsim_uartfd, &c, 1);
+      (void)n; // A reply the other end isn't reading for is lost
+    }
+    return *this;
+  }
+  operator uint8_t() {
+    uint8_t c = hostsim_uartbyte;
+    hostsim_uartbyte   = -1;
+    hostsim_uartstatus = 0;
+    hostsim_uartnext = hostsim_now + hostsim_uartTicks();
+    return c;
+  }
+};
+
+HostUartStatus UCSRA;
+HostUartData   UDR;
+
+uint32_t hostsim_uartTicks(void) {
+  return 10UL * ((UCSRA.value & _BV(U2X)) ? 8 : 16) *
+    (((uint16_t)UBRRH << 8 | UBRRL) + 1);
+}
+
+void hostsim_delayCycles(uint32_t n) {
+  hostsim_now      += n;
+  TCNT1            += n;
+  TCNT1.mark       += n; // Counted in value already
+  hostsim_isrticks += n;
+}
+
+void sei(void) { hostsim_ienable = true;  }
+void cli(void) { hostsim_ienable = false; }
+
+struct {
+  uint8_t  shift[HOSTSIM_MAXWIDTH]; // Column shift register, data bits 2-7
+  uint8_t  latch[HOSTSIM_MAXWIDTH]; // Output latches, loaded on LAT rising
+  uint8_t  clk, lat, oe, addr;      // Last sampled control lines
+  bool     discard;                 // Drop the row visit in progress
+  uint64_t onsince;                 // Tick of last on-time credit
+  uint32_t pending[HOSTSIM_MAXWIDTH][6], pendingtime; // Current row visit
+  uint32_t lit[HOSTSIM_MAXROWS][HOSTSIM_MAXWIDTH][6];  // Per-LED on-time
+  uint32_t rowtime[HOSTSIM_MAXROWS];                   // Per-row lit time
+  uint64_t lastlit[HOSTSIM_MAXROWS]; // Tick each row was last lit until
+  uint64_t darkmax;                  // Longest time any row spent dark
+} hostsim_panel;
+
+// Credit time since the last call to the row and data currently shown.
+// On-time is held per row visit and only committed once the address
+// moves on, so image decoding never sees a partly shown row.
+static void hostsim_credit(bool rowchange) {
+  uint32_t dt = (uint32_t)(hostsim_now - hostsim_panel.onsince);
+  uint8_t  c, b;
+
+  if(dt) {
+    // Row just lit for dt; how long since it was lit before?
+    uint64_t *last = &hostsim_panel.lastlit[hostsim_panel.addr];
+    if(*last && (hostsim_panel.onsince - *last > hostsim_panel.darkmax))
+      hostsim_panel.darkmax = hostsim_panel.onsince - *last;
+    *last = hostsim_now;
+  }
+  hostsim_panel.onsince = hostsim_now;
+  if(dt) {
+    hostsim_panel.pendingtime += dt;
+    for(c=0; c<HOSTSIM_MAXWIDTH; c++) {
+      for(b=0; b<6; b++) {
+        if(hostsim_panel.latch[c] & (4 << b))
+          hostsim_panel.pending[c][b] += dt;
+      }
+    }
+  }
+  if(rowchange) {
+    if(!hostsim_panel.discard) {
+      uint8_t a = hostsim_panel.addr;
+      hostsim_panel.rowtime[a] += hostsim_panel.pendingtime;
+      for(c=0; c<HOSTSIM_MAXWIDTH; c++) {
+        for(b=0; b<6; b++)
+          hostsim_panel.lit[a][c][b] += hostsim_panel.pending[c][b];
+      }
+    }
+    hostsim_panel.discard     = false;
+    hostsim_panel.pendingtime = 0;
+    memset(hostsim_panel.pending, 0, sizeof(hostsim_panel.pending));
+  }
+}
+
+// Sample the panel control lines after every port store.
+void hostsim_portWrite(void) {
+  uint8_t clk  = (CLK_PORT >> CLK_PIN) & 1,
+          lat  = (LAT_PORT >> LAT_PIN) & 1,
+          oe   = (OE_PORT  >> OE_PIN ) & 1,
+          addr = ( (A_PORT >> A_PIN) & 1)       |
+                 (((B_PORT >> B_PIN) & 1) << 1) |
+                 (((C_PORT >> C_PIN) & 1) << 2) |
+                 (((D_PORT >> D_PIN) & 1) << 3);
+
+  // Settle on-time for whatever was shown up to this instant
+  if(!hostsim_panel.oe) hostsim_credit(false);
+  else                  hostsim_panel.onsince = hostsim_now;
+  if(addr != hostsim_panel.addr) {
+    hostsim_credit(true);
+    hostsim_panel.addr = addr;
+  }
+
+  if(clk && !hostsim_panel.clk) { // Rising CLK: shift one column in
+    memmove(&hostsim_panel.shift[1], &hostsim_panel.shift[0],
+      HOSTSIM_MAXWIDTH - 1);
+    hostsim_panel.shift[0] = DATAPORT;
+  }
+  if(lat && !hostsim_panel.lat) { // Rising LAT: load output latches
+    memcpy(hostsim_panel.latch, hostsim_panel.shift, HOSTSIM_MAXWIDTH);
+  }
+  hostsim_panel.clk = clk;
+  hostsim_panel.lat = lat;
+  hostsim_panel.oe  = oe;
+}
+
+// Forget everything shown so far; decoding restarts at the next row.
+void hostsim_panelReset(void) {
+  memset(hostsim_panel.lit, 0, sizeof(hostsim_panel.lit));
+  memset(hostsim_panel.rowtime, 0, sizeof(hostsim_panel.rowtime));
+  memset(hostsim_panel.lastlit, 0, sizeof(hostsim_panel.lastlit));
+  hostsim_panel.darkmax = 0;
+  hostsim_panel.discard = true;
+}
+
+// Advance simulated time, running the Timer1 overflow handler as due.
+// Timer1 runs in mode 14 (TOP = ICR1) with no prescaler, as set up by
+// RGBmatrixPanel_begin().
+void hostsim_run(uint32_t ticks) {
+  while(ticks) {
+    if(!(TCCR1B & 0x07)) { // Timer stopped
+      hostsim_now += ticks;
+      return;
+    }
+    uint32_t left = (TCNT1 <= ICR1) ? (uint32_t)ICR1 + 1 - TCNT1 : 1;
+    if(ticks < left) {
+      TCNT1       += ticks;
+      hostsim_now += ticks;
+      return;
+    }
+    hostsim_now += left;
+    ticks       -= left;
+    TCNT1        = 0;
+    TIFR        |= _BV(TOV1);
+    if(hostsim_ienable && (TIMSK & _BV(TOIE1))) {
+      // Timer keeps counting through interrupt entry
+      hostsim_now     += HOSTSIM_LATENCY;
+      hostsim_isrticks = 0;
+      TCNT1            = HOSTSIM_LATENCY;
+      ticks            = (ticks > HOSTSIM_LATENCY) ? ticks - HOSTSIM_LATENCY : 0;
+      hostsim_ienable  = false; // ISR_BLOCK
+      hostsim_inisr    = true;
+      TIFR            &= ~_BV(TOV1); // Cleared on entering the vector
+      TIMER1_OVF_vect();
+      hostsim_inisr    = false;
+      hostsim_ienable  = true;
+      if(hostsim_isrhook) hostsim_isrhook();
+    }
+  }
+}
+
+void _delay_ms(double ms) {
+  hostsim_run((uint32_t)(ms * (F_CPU / 1000UL)));
+}
+
+// Image shown on the virtual panel since the last hostsim_panelReset(),
+// as 3 bytes (R,G,B) per pixel scaled 0 to 'levels'.  Pixel x sits at
+// the far end of the shift chain from the first column clocked in.
+void hostsim_panelImage(uint8_t width, uint8_t height, uint8_t levels,
+  uint8_t *rgb) {
+  uint8_t  rows = height / 2, x, y, i, half;
+  uint32_t t;
+
+  for(y=0; y<height; y++) {
+    half = (y < rows) ? 0 : 3;
+    t    = hostsim_panel.rowtime[y % rows];
+    for(x=0; x<width; x++) {
+      for(i=0; i<3; i++) {
+        *rgb++ = t ? (uint8_t)(((uint64_t)hostsim_panel.lit[y % rows]
+          [width - 1 - x][half + i] * levels + t / 2) / t) : 0;
+      }
+    }
+  }
+}
+
+// Unpack a matrixbuff[] image straight from RAM, no scanning involved:
+// 3 bytes (R,G,B) per pixel, each 0 to (1 << planes) - 1.  Mirrors the
+// bit layout documented in RGBmatrixPanel_makePattern(): plane 0 is
+// packed into planes 1-3 when there are 4 or more planes.
+void hostsim_decodeBuffer(const uint8_t *buf, uint8_t width, uint8_t rows,
+  uint8_t planes, uint8_t *rgb) {
+  const uint8_t *ptr;
+  uint8_t        x, y, p, r, g, b, shift, packed = (planes >= 4);
+
+  for(y=0; y<rows*2; y++) {
+    for(x=0; x<width; x++) {
+      ptr   = &buf[(y % rows) * width * (planes - packed) + x];
+      shift = (y < rows) ? 2 : 5;
+      r = g = b = 0;
+      if(packed && (y < rows)) {
+        r     =  ptr[width*2]       & 1;
+        g     = (ptr[width*2] >> 1) & 1;
+        b     =  ptr[width]         & 1;
+      } else if(packed) {
+        r     = (ptr[width] >> 1) & 1;
+        g     =  ptr[0]           & 1;
+        b     = (ptr[0]     >> 1) & 1;
+      }
+      for(p=packed; p<planes; p++, ptr += width) {
+        r |= ((*ptr >>  shift     ) & 1) << p;
+        g |= ((*ptr >> (shift + 1)) & 1) << p;
+        b |= ((*ptr >> (shift + 2)) & 1) << p;
+      }
+      *rgb++ = r;
+      *rgb++ = g;
+      *rgb++ = b;
+    }
+  }
+}
+
+#endif // HOSTSIM_H